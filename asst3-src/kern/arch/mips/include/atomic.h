@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+/*
+ * Atomic operations using LL/SC. See <machine/spinlock.h> for how
+ * LL/SC work; as there, nothing between the LL and the SC may touch
+ * memory. The "memory" clobber keeps gcc from caching values across
+ * the operation.
+ *
+ * See include/atomic.h for further information.
+ */
+
+ATOMIC_INLINE
+int
+atomic_add(volatile int *p, int delta)
+{
+	int old, new;
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   old = *p */
+			"addu %1, %0, %3;"	/*   new = old + delta */
+			"sc %1, 0(%2);"		/*   *p = new; new = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (old), "=&r" (new)
+			: "r" (p), "r" (delta)
+			: "memory");
+	} while (new == 0);
+
+	return old + delta;
+}
+
+ATOMIC_INLINE
+bool
+atomic_cas(volatile int *p, int oldval, int newval)
+{
+	int x, y;
+
+	/*
+	 * Y starts out as 0 (failure). If *P isn't OLDVAL, skip the
+	 * SC and fail; otherwise the SC leaves 1 in Y if it worked.
+	 * A failed SC also counts as failure; the caller retries.
+	 */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"move %1, $0;"		/*   y = 0 */
+		"ll %0, 0(%2);"		/*   x = *p */
+		"bne %0, %3, 1f;"	/*   if (x != oldval) goto 1 */
+		"move %1, %4;"		/*   y = newval */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"1:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (oldval), "r" (newval)
+		: "memory");
+
+	return y != 0;
+}
+
+#endif /* _MIPS_ATOMIC_H_ */
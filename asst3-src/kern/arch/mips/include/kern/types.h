@@ -71,6 +71,9 @@ typedef long __ssize_t;                 /* Signed type of same size */
 typedef long __ptrdiff_t;               /* Difference of two pointers */
 #endif
 
+/* Largest value of ssize_t (either way, it's 32 bits). */
+#define __SSIZE_MAX 0x7fffffff
+
 /* Number of bits per byte. */
 #define __CHAR_BIT  8
 
@@ -41,6 +41,8 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <cpustat.h>
+#include <prof.h>
 
 
 /* in exception-*.S */
@@ -193,6 +195,12 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		cpustat_inc(CPUSTAT_INTERRUPTS);
+#if OPT_PROF
+		/* Tell the profiler where we were, in case of hardclock. */
+		curcpu->c_intrpc = tf->tf_epc;
+		curcpu->c_intruser = !iskern;
+#endif
 		mainbus_interrupt(tf);
 
 		if (doadjust) {
@@ -37,6 +37,8 @@
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <cpustat.h>
+#include <trace.h>
 
 
 /*
@@ -89,6 +91,8 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	cpustat_inc(CPUSTAT_SYSCALLS);
+	TRACE(TRACE_SYSCALL, callno, 0);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -113,6 +117,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -142,6 +151,37 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS___threadfork:
+		err = sys___threadfork(tf,
+				       (userptr_t)tf->tf_a0,
+				       (userptr_t)tf->tf_a1,
+				       &retval);
+		break;
+
+	    case SYS_threadexit:
+		sys_threadexit(tf->tf_a0);
+		panic("Returning from threadexit\n");
+
+	    case SYS_threadjoin:
+		err = sys_threadjoin(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0,
+				     tf->tf_a1,
+				     (const_userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0,
+				     tf->tf_a1,
+				     &retval);
+		break;
+
+	    case SYS_setaffinity:
+		err = sys_setaffinity(tf->tf_a0);
+		break;
+
 
 	    /* file calls */
 
@@ -164,6 +204,10 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +222,64 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			/*
+			 * The 64-bit offset has to be aligned to an
+			 * even register pair, so it skips a3 and goes
+			 * on the stack.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (const_userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_pwritev:
+				err = sys_pwritev(tf->tf_a0,
+						  (const_userptr_t)tf->tf_a1,
+						  tf->tf_a2, pos, &retval);
+				break;
+			}
+		}
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -211,6 +313,33 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_select:
+		{
+			/* The fifth argument (the timeout) is on the stack. */
+			userptr_t timeout;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &timeout, sizeof(timeout));
+			if (err) {
+				break;
+			}
+
+			err = sys_select(tf->tf_a0,
+					 (userptr_t)tf->tf_a1,
+					 (userptr_t)tf->tf_a2,
+					 (userptr_t)tf->tf_a3,
+					 timeout, &retval);
+		}
+		break;
+
 	    case SYS_chdir:
 		err = sys_chdir((userptr_t)tf->tf_a0);
 		break;
@@ -232,6 +361,7 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	TRACE(TRACE_SYSRET, callno, err);
 
 	if (err) {
 		/*
@@ -279,3 +409,25 @@ enter_forked_process(struct trapframe *tf)
 
 	mips_usermode(tf);
 }
+
+/*
+ * Enter user mode for a new thread in an existing process.
+ *
+ * TF is a copy of the creating thread's trapframe, so the new thread
+ * starts with the same global pointer and status register; it begins
+ * at ENTRYPOINT with ARG as its argument and the stack at STACKPTR.
+ * There is nothing to return to; the user-level entry point must
+ * call threadexit.
+ */
+void
+enter_new_thread(struct trapframe *tf, userptr_t arg,
+		 vaddr_t stackptr, vaddr_t entrypoint)
+{
+	tf->tf_a0 = (vaddr_t)arg;
+	tf->tf_sp = stackptr;
+	tf->tf_epc = entrypoint;
+	tf->tf_t9 = entrypoint;	/* as for any call through a pointer */
+	tf->tf_ra = 0;
+
+	mips_usermode(tf);
+}
@@ -35,6 +35,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <clock.h>
+#include <timer.h>
 #include <thread.h>
 #include <current.h>
 #include <membar.h>
@@ -51,6 +52,7 @@
  * real-time clock instead of compiling it in like this.
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
+#define NSECS_PER_CYCLE (1000000000 / CPU_FREQUENCY)
 
 /*
  * Access to the on-chip timer.
@@ -58,18 +60,23 @@
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
  * asserted. Writing to c0_compare again clears the interrupt.
+ *
+ * We also zero c0_count, so the next interrupt comes COUNT cycles
+ * from now even when we reprogram the timer partway through an
+ * interval (see timer.c).
  */
 static
 void
 mips_timer_set(uint32_t count)
 {
 	/*
-	 * $11 == c0_compare; we can't use the symbolic name inside
-	 * the asm string.
+	 * $9 == c0_count, $11 == c0_compare; we can't use the
+	 * symbolic names inside the asm string.
 	 */
 	__asm volatile(
 		".set push;"		/* save assembler mode */
 		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 $0, $9;"		/* restart the count */
 		"mtc0 %0, $11;"		/* do it */
 		".set pop"		/* restore assembler mode */
 		:: "r" (count));
@@ -275,6 +282,15 @@ mainbus_send_ipi(struct cpu *target)
 	lamebus_assert_ipi(lamebus, target);
 }
 
+/*
+ * Program the on-chip timer of the current cpu.
+ */
+void
+mainbus_settimer(uint32_t nsecs)
+{
+	mips_timer_set(nsecs / NSECS_PER_CYCLE);
+}
+
 /*
  * Interrupt dispatcher.
  */
@@ -304,10 +320,17 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
+		uint32_t nsecs;
+		bool tick;
+
+		/* Run expired timers and find the next deadline */
+		tick = timer_interrupt(&nsecs);
 		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
-		hardclock();
+		mainbus_settimer(nsecs);
+		/* and call hardclock if it's time */
+		if (tick) {
+			hardclock();
+		}
 		seen = true;
 	}
 
@@ -174,6 +174,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollq_wakeup(&cs->cs_pollq);
 }
 
 /*
@@ -302,10 +303,32 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Poll. Input is ready if there are characters in the buffer; we can
+ * always write, since output only waits for the hardware.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollset *ps)
+{
+	struct con_softc *cs = dev->d_data;
+	int revents = 0;
+
+	if (ps != NULL) {
+		pollset_register(ps, &cs->cs_pollq);
+	}
+	if (cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		revents |= events & (POLLIN | POLLRDNORM);
+	}
+	revents |= events & (POLLOUT | POLLWRNORM);
+	return revents;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +409,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollq_init(&cs->cs_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
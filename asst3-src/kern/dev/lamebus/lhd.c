@@ -36,9 +36,11 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
-#include <synch.h>
+#include <spinlock.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <cpustat.h>
+#include <trace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -96,15 +98,215 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Request queue.
+ *
+ * Requests are kept in a queue of chains, and the device is driven
+ * from the interrupt handler: when a sector completes, the next one
+ * is started immediately, and the thread that submitted a request is
+ * only woken when all of it is done. When a chain finishes, the next
+ * is chosen C-LOOK style: the lowest-numbered chain at or beyond the
+ * current head position, or if there is none, the lowest-numbered
+ * chain overall.
+ */
+
+/* Longest chain we'll build by merging, in sectors. */
+#define LHD_MAXCHAIN	128
+
+/*
+ * Size of bounce buffer for I/O we can't do in place, in sectors.
+ * Keep it within a page; kmalloc can't get more than one at a time.
+ */
+#define LHD_BOUNCE	8
+
+/*
+ * Start the current sector of the active request.
+ */
+static
+void
+lhd_start(struct lhd_softc *lh)
+{
+	struct devreq *r = lh->lh_active;
+	uint32_t sector, statval;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+	KASSERT(r != NULL);
+	KASSERT(r->dr_pos < r->dr_nblocks);
+
+	sector = r->dr_block + r->dr_pos;
+	statval = LHD_WORKING;
+
+	/* If writing, transfer the data to the on-card buffer. */
+	if (r->dr_write) {
+		memcpy(lh->lh_buf,
+		       (char *)r->dr_data + r->dr_pos * LHD_SECTSIZE,
+		       LHD_SECTSIZE);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, sector);
+
+	/* and start the operation. */
+	TRACE(TRACE_DISKSTART, sector, r->dr_write);
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+
+	lh->lh_headpos = sector + 1;
+}
+
+/*
+ * Take the next chain to run off the queue (C-LOOK).
+ */
+static
+struct devreq *
+lhd_pick(struct lhd_softc *lh)
+{
+	struct devreq *r, **rp, **ahead, **lowest;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	ahead = lowest = NULL;
+	for (rp = &lh->lh_queue; *rp != NULL; rp = &(*rp)->dr_next) {
+		r = *rp;
+		if (lowest == NULL || r->dr_block < (*lowest)->dr_block) {
+			lowest = rp;
+		}
+		if (r->dr_block >= lh->lh_headpos &&
+		    (ahead == NULL || r->dr_block < (*ahead)->dr_block)) {
+			ahead = rp;
+		}
+	}
+	if (ahead == NULL) {
+		ahead = lowest;
+	}
+	if (ahead == NULL) {
+		return NULL;
+	}
+	r = *ahead;
+	*ahead = r->dr_next;
+	r->dr_next = NULL;
+	return r;
+}
+
+/*
+ * Add a request to the queue, merging it into a pending chain for
+ * adjacent sectors in the same direction if possible, and start the
+ * device if it's idle. (devop_submit)
+ */
+static
+int
+lhd_submit(struct device *d, struct devreq *r)
+{
+	struct lhd_softc *lh = d->d_data;
+	struct devreq *q, **qp, *tail;
+
+	/* Don't allow I/O past the end of the disk. */
+	if (r->dr_block + r->dr_nblocks < r->dr_block ||
+	    r->dr_block + r->dr_nblocks > lh->lh_dev.d_blocks) {
+		return EINVAL;
+	}
+
+	r->dr_pos = 0;
+	r->dr_chainend = r->dr_block + r->dr_nblocks;
+	r->dr_chain = NULL;
+	r->dr_next = NULL;
+
+	spinlock_acquire(&lh->lh_lock);
+
+	if (lh->lh_active == NULL) {
+		KASSERT(lh->lh_queue == NULL);
+		lh->lh_active = r;
+		lhd_start(lh);
+		spinlock_release(&lh->lh_lock);
+		return 0;
+	}
+
+	for (qp = &lh->lh_queue; *qp != NULL; qp = &(*qp)->dr_next) {
+		q = *qp;
+		if (q->dr_write != r->dr_write ||
+		    q->dr_chainend - q->dr_block + r->dr_nblocks > LHD_MAXCHAIN) {
+			continue;
+		}
+		if (q->dr_chainend == r->dr_block) {
+			/* Goes on the end of Q's chain */
+			for (tail = q; tail->dr_chain != NULL;
+			     tail = tail->dr_chain) {
+				/* nothing */
+			}
+			tail->dr_chain = r;
+			q->dr_chainend = r->dr_chainend;
+			spinlock_release(&lh->lh_lock);
+			return 0;
+		}
+		if (r->dr_chainend == q->dr_block) {
+			/* Goes in front of Q's chain, and replaces it */
+			r->dr_chain = q;
+			r->dr_chainend = q->dr_chainend;
+			r->dr_next = q->dr_next;
+			q->dr_next = NULL;
+			*qp = r;
+			spinlock_release(&lh->lh_lock);
+			return 0;
+		}
+	}
+
+	r->dr_next = lh->lh_queue;
+	lh->lh_queue = r;
+	spinlock_release(&lh->lh_lock);
+	return 0;
+}
+
+/*
+ * Record that a sector has completed: copy the data out if reading,
+ * and either start the next sector, or finish the request and start
+ * the next one.
  */
 static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct devreq *r;
+
+	spinlock_acquire(&lh->lh_lock);
+
+	r = lh->lh_active;
+	if (r == NULL) {
+		/* Spurious */
+		spinlock_release(&lh->lh_lock);
+		return;
+	}
+
+	cpustat_inc(CPUSTAT_DISKIO);
+	TRACE(TRACE_DISKDONE, r->dr_block + r->dr_pos, err);
+
+	/* If reading and we succeeded, copy out of the on-card buffer. */
+	if (err == 0 && !r->dr_write) {
+		membar_load_load();
+		memcpy((char *)r->dr_data + r->dr_pos * LHD_SECTSIZE, lh->lh_buf,
+		       LHD_SECTSIZE);
+	}
+	r->dr_pos++;
+
+	if (err == 0 && r->dr_pos < r->dr_nblocks) {
+		/* More to do */
+		lhd_start(lh);
+		spinlock_release(&lh->lh_lock);
+		return;
+	}
+
+	/* This request is done; the rest of its chain is independent. */
+	lh->lh_active = r->dr_chain;
+	if (lh->lh_active == NULL) {
+		lh->lh_active = lhd_pick(lh);
+	}
+	if (lh->lh_active != NULL) {
+		lhd_start(lh);
+	}
+
+	spinlock_release(&lh->lh_lock);
+
+	/* Not under our lock: the callback may submit more requests. */
+	devreq_complete(r, err);
 }
 
 /*
@@ -179,6 +381,180 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Advance a kernel-space uio past LEN bytes that were transferred
+ * directly to or from its buffers.
+ */
+static
+void
+lhd_uioskip(struct uio *uio, size_t len)
+{
+	struct iovec *iov;
+	size_t amt;
+
+	KASSERT(uio->uio_segflg == UIO_SYSSPACE);
+	KASSERT(len <= uio->uio_resid);
+
+	while (len > 0) {
+		iov = uio->uio_iov;
+		amt = iov->iov_len < len ? iov->iov_len : len;
+		iov->iov_kbase = (char *)iov->iov_kbase + amt;
+		iov->iov_len -= amt;
+		uio->uio_offset += amt;
+		uio->uio_resid -= amt;
+		len -= amt;
+		if (iov->iov_len == 0) {
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
+		}
+	}
+}
+
+/*
+ * Check if a uio can be done in place: it has to be in kernel space
+ * and every buffer has to be a whole number of sectors.
+ */
+static
+bool
+lhd_uio_direct(struct uio *uio)
+{
+	size_t left = uio->uio_resid;
+	unsigned i;
+
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		return false;
+	}
+	for (i=0; i<uio->uio_iovcnt && left > 0; i++) {
+		if (uio->uio_iov[i].iov_len % LHD_SECTSIZE != 0) {
+			return false;
+		}
+		left -= uio->uio_iov[i].iov_len < left ?
+			uio->uio_iov[i].iov_len : left;
+	}
+	return true;
+}
+
+/*
+ * Do a kernel-space uio in place: submit one request per buffer, all
+ * at once, so they can be merged, then wait for them all.
+ */
+static
+int
+lhd_io_direct(struct lhd_softc *lh, struct uio *uio)
+{
+	struct devreq *reqs;
+	uint32_t sector, nsect;
+	unsigned i, n;
+	size_t left, done;
+	int result, ret;
+
+	reqs = kmalloc(uio->uio_iovcnt * sizeof(*reqs));
+	if (reqs == NULL) {
+		return ENOMEM;
+	}
+
+	sector = uio->uio_offset / LHD_SECTSIZE;
+	left = uio->uio_resid;
+	n = 0;
+	result = 0;
+	for (i=0; i<uio->uio_iovcnt && left > 0; i++) {
+		nsect = uio->uio_iov[i].iov_len / LHD_SECTSIZE;
+		if (nsect * LHD_SECTSIZE > left) {
+			nsect = left / LHD_SECTSIZE;
+		}
+		if (nsect == 0) {
+			continue;
+		}
+		reqs[n].dr_block = sector;
+		reqs[n].dr_nblocks = nsect;
+		reqs[n].dr_write = (uio->uio_rw == UIO_WRITE);
+		reqs[n].dr_data = uio->uio_iov[i].iov_kbase;
+		reqs[n].dr_done = NULL;
+		result = dev_submit(&lh->lh_dev, &reqs[n]);
+		if (result) {
+			break;
+		}
+		n++;
+		sector += nsect;
+		left -= nsect * LHD_SECTSIZE;
+	}
+
+	/* Wait for everything; report the first failure. */
+	ret = result;
+	done = 0;
+	for (i=0; i<n; i++) {
+		result = dev_wait(&reqs[i]);
+		if (result && ret == 0) {
+			ret = result;
+		}
+		if (ret == 0) {
+			done += reqs[i].dr_nblocks * LHD_SECTSIZE;
+		}
+	}
+	kfree(reqs);
+
+	lhd_uioskip(uio, done);
+	return ret;
+}
+
+/*
+ * Do any other uio through a bounce buffer.
+ */
+static
+int
+lhd_io_bounce(struct lhd_softc *lh, struct uio *uio)
+{
+	struct devreq req;
+	char *buf;
+	size_t len;
+	int result;
+
+	buf = kmalloc(LHD_BOUNCE * LHD_SECTSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > LHD_BOUNCE * LHD_SECTSIZE) {
+			len = LHD_BOUNCE * LHD_SECTSIZE;
+		}
+
+		req.dr_block = uio->uio_offset / LHD_SECTSIZE;
+		req.dr_nblocks = len / LHD_SECTSIZE;
+		req.dr_write = (uio->uio_rw == UIO_WRITE);
+		req.dr_data = buf;
+		req.dr_done = NULL;
+
+		if (req.dr_write) {
+			result = uiomove(buf, len, uio);
+			if (result) {
+				break;
+			}
+		}
+
+		result = dev_submit(&lh->lh_dev, &req);
+		if (result) {
+			break;
+		}
+		result = dev_wait(&req);
+		if (result) {
+			break;
+		}
+
+		if (!req.dr_write) {
+			result = uiomove(buf, len, uio);
+			if (result) {
+				break;
+			}
+		}
+	}
+
+	kfree(buf);
+	return result;
+}
+
 /*
  * I/O function (for both reads and writes)
  */
@@ -192,9 +568,6 @@ lhd_io(struct device *d, struct uio *uio)
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
-	int result;
 
 	/* Don't allow I/O that isn't sector-aligned. */
 	if (sectoff != 0 || lenoff != 0) {
@@ -207,67 +580,21 @@ lhd_io(struct device *d, struct uio *uio)
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (len == 0) {
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
-
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
-
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
-		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
-			if (result) {
-				V(lh->lh_clear);
-				return result;
-			}
-		}
-
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
-
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
-
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
-
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-		}
-
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
-
-		/* If we failed, return the error. */
-		if (result) {
-			return result;
-		}
+	if (lhd_uio_direct(uio)) {
+		return lhd_io_direct(lh, uio);
 	}
-
-	return 0;
+	return lhd_io_bounce(lh, uio);
 }
 
 static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_submit = lhd_submit,
 };
 
 /*
@@ -284,17 +611,11 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
-	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
-		return ENOMEM;
-	}
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_queue = NULL;
+	lh->lh_active = NULL;
+	lh->lh_headpos = 0;
 
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_ops = &lhd_devops;
@@ -33,6 +33,7 @@
 #include <array.h>
 #include <fs.h>
 #include <vnode.h>
+#include <poll.h>
 
 #ifndef SEMFS_INLINE
 #define SEMFS_INLINE INLINE
@@ -55,6 +56,7 @@ struct semfs_sem {
 	struct lock *sems_lock;			/* Lock to protect count */
 	struct cv *sems_cv;			/* CV to wait */
 	unsigned sems_count;			/* Semaphore count */
+	struct pollq sems_pollq;		/* Pollers waiting for P */
 	bool sems_hasvnode;			/* The vnode exists */
 	bool sems_linked;			/* In the directory */
 };
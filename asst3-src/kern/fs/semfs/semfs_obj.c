@@ -63,6 +63,7 @@ semfs_sem_create(const char *name)
 		goto fail_lock;
 	}
 	sem->sems_count = 0;
+	pollq_init(&sem->sems_pollq);
 	sem->sems_hasvnode = false;
 	sem->sems_linked = false;
 	return sem;
@@ -81,6 +82,7 @@ semfs_sem_create(const char *name)
 void
 semfs_sem_destroy(struct semfs_sem *sem)
 {
+	pollq_cleanup(&sem->sems_pollq);
 	cv_destroy(sem->sems_cv);
 	lock_destroy(sem->sems_lock);
 	kfree(sem);
@@ -136,7 +136,8 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. Pollers likewise only care about the count
+ * becoming nonzero.
  */
 static
 void
@@ -151,6 +152,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollq_wakeup(&sem->sems_pollq);
 }
 
 /*
@@ -291,6 +293,34 @@ semfs_truncate(struct vnode *vn, off_t len)
 	return 0;
 }
 
+/*
+ * Poll. A semaphore is readable (P won't block) when the count is
+ * nonzero, and always writable.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct pollset *ps)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+	int revents;
+
+	sem = semfs_getsem(semv);
+
+	if (ps != NULL) {
+		pollset_register(ps, &sem->sems_pollq);
+	}
+
+	revents = events & (POLLOUT | POLLWRNORM);
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		revents |= events & (POLLIN | POLLRDNORM);
+	}
+	lock_release(sem->sems_lock);
+
+	return revents;
+}
+
 ////////////////////////////////////////////////////////////
 // directory ops
 
@@ -603,19 +633,13 @@ semfs_reclaim(struct vnode *vn)
 
 	lock_acquire(semfs->semfs_tablelock);
 
-	/* vnode refcount is protected by the vnode's ->vn_countlock */
-	spinlock_acquire(&vn->vn_countlock);
-	if (vn->vn_refcount > 1) {
-		/* consume the reference VOP_DECREF passed us */
-		vn->vn_refcount--;
-
-		spinlock_release(&vn->vn_countlock);
+	/* holding the table lock, nobody can pick the vnode up again */
+	if (!vnode_reclaimable(vn)) {
+		/* it consumed the reference VOP_DECREF passed us */
 		lock_release(semfs->semfs_tablelock);
 		return EBUSY;
 	}
 
-	spinlock_release(&vn->vn_countlock);
-
 	/* remove from the table */
 	num = vnodearray_num(semfs->semfs_vnodes);
 	for (i=0; i<num; i++) {
@@ -699,6 +723,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = semfs_poll,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
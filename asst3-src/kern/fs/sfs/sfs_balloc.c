@@ -39,16 +39,24 @@
 #include "sfsprivate.h"
 
 /*
- * Zero out a disk block.
+ * Zero out a disk block. This is done in the buffer cache; the zeros
+ * reach the disk when the buffer is written back.
  */
 static
 int
 sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
+	struct sfs_buf *buf;
+	int result;
 
-	return sfs_writeblock(sfs, block, zeros, SFS_BLOCKSIZE);
+	result = sfs_buf_get(sfs, block, &buf);
+	if (result) {
+		return result;
+	}
+	bzero(sfs_buf_data(buf), SFS_BLOCKSIZE);
+	sfs_buf_dirty(buf);
+	sfs_buf_release(buf);
+	return 0;
 }
 
 /*
@@ -86,6 +94,9 @@ sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+
+	/* Don't bother writing back whatever was cached for it */
+	sfs_buf_discard(sfs, diskblock);
 }
 
 /*
@@ -49,24 +49,16 @@ int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	 daddr_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
+	uint32_t *idbuf;
 	daddr_t block;
 	daddr_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(SFS_DBPERIDB*sizeof(idbuf[0])==SFS_BLOCKSIZE);
 
-	/* Since we're using a static buffer, we'd better be locked. */
 	KASSERT(vfs_biglock_do_i_hold());
 
 	/*
@@ -154,18 +146,17 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		/* Mark the inode dirty */
 		sv->sv_dirty = true;
 
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
+		/* sfs_balloc zeroed it in the buffer cache */
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
-		}
+
+	/*
+	 * Get the indirect block.
+	 */
+	result = sfs_buf_read(sfs, idblock, &buf);
+	if (result) {
+		return result;
 	}
+	idbuf = sfs_buf_data(buf);
 
 	/* Get the block out of the indirect block buffer */
 	block = idbuf[idoff];
@@ -174,18 +165,17 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	if (block==0 && doalloc) {
 		result = sfs_balloc(sfs, &block);
 		if (result) {
+			sfs_buf_release(buf);
 			return result;
 		}
 
 		/* Remember the block we allocated */
 		idbuf[idoff] = block;
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
-		}
+		/* The indirect block is now dirty */
+		sfs_buf_dirty(buf);
 	}
+	sfs_buf_release(buf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -203,16 +193,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 int
 sfs_itrunc(struct sfs_vnode *sv, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
+	uint32_t *idbuf;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
@@ -223,8 +206,6 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	int result;
 	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	vfs_biglock_acquire();
 
 	/*
@@ -253,11 +234,12 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		/* We're past the proposed EOF; may need to free stuff */
 
 		/* Read the indirect block */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_buf_read(sfs, idblock, &buf);
 		if (result) {
 			vfs_biglock_release();
 			return result;
 		}
+		idbuf = sfs_buf_data(buf);
 
 		hasnonzero = 0;
 		iddirty = 0;
@@ -274,21 +256,18 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 			}
 		}
 
+		if (iddirty) {
+			/* The indirect block is dirty */
+			sfs_buf_dirty(buf);
+		}
+		sfs_buf_release(buf);
+
 		if (!hasnonzero) {
 			/* The whole indirect block is empty now; free it */
 			sfs_bfree(sfs, idblock);
 			sv->sv_i.sfi_indirect = 0;
 			sv->sv_dirty = true;
 		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_writeblock(sfs, idblock, idbuf,
-						sizeof(idbuf));
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
 	}
 
 	/* Set the file size */
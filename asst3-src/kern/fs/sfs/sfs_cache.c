@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * SFS filesystem
+ *
+ * Buffer cache.
+ *
+ * All file data, directory, indirect and inode blocks are accessed
+ * through here; the superblock and free block bitmap, which are kept
+ * in memory whole anyway, still use sfs_readblock/sfs_writeblock
+ * directly. One pool of buffers is shared by every mounted SFS
+ * volume; buffers are keyed by (device, block).
+ *
+ * Users get a buffer with sfs_buf_read (which reads the block in if
+ * it isn't cached) or sfs_buf_get (which doesn't, for callers about
+ * to overwrite the whole block), and hold it pinned until they call
+ * sfs_buf_release. Modified buffers are marked with sfs_buf_dirty
+ * and written back when evicted or when the volume is synced.
+ *
+ * Unpinned buffers are kept on an LRU list; when the pool is full the
+ * least recently used one is recycled. If every buffer is pinned the
+ * pool is allowed to grow past SFS_NBUFS, since the number of
+ * buffers any one operation pins is small.
+ *
+ * Writes are delayed. A syncer thread wakes once a second and writes
+ * back buffers that have been dirty for SFS_SYNCAGE seconds, or every
+ * dirty buffer if more than SFS_DIRTYMAX are dirty. Write-back sorts
+ * the buffers by block number and queues them all with the device
+ * before waiting, so the driver can merge consecutive blocks.
+ *
+ * Read-ahead likewise queues reads without waiting; a buffer with
+ * I/O in flight is marked busy, and anyone who wants it (including
+ * the eviction code) waits for the I/O first.
+ *
+ * Like the rest of SFS, all of this is protected by the vfs biglock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <clock.h>
+#include <thread.h>
+#include <vfs.h>
+#include <device.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/* Number of buffers to keep (each SFS_BLOCKSIZE bytes of data). */
+#define SFS_NBUFS	128
+
+/* Number of hash chains. */
+#define SFS_BUFHASH	64
+
+/* Age in seconds at which the syncer writes a dirty buffer. */
+#define SFS_SYNCAGE	5
+
+/* Number of dirty buffers above which the syncer writes all of them. */
+#define SFS_DIRTYMAX	(SFS_NBUFS / 4)
+
+struct sfs_buf {
+	struct sfs_fs *b_fs;		/* volume (for I/O) */
+	struct device *b_dev;		/* device (for lookup) */
+	daddr_t b_block;		/* block number */
+	bool b_valid;			/* data is meaningful */
+	bool b_dirty;			/* data is newer than on disk */
+	unsigned b_dirtytime;		/* sfs_bufclock when first dirtied */
+	unsigned b_pincount;		/* number of users */
+	bool b_busy;			/* b_req in flight */
+	struct devreq b_req;		/* for async I/O */
+	struct sfs_buf *b_hashnext;	/* hash chain */
+	struct sfs_buf *b_lrunext;	/* LRU list (unpinned only) */
+	struct sfs_buf *b_lruprev;
+	char b_data[SFS_BLOCKSIZE];	/* the block */
+};
+
+static struct sfs_buf *sfs_bufhash[SFS_BUFHASH];
+static struct sfs_buf *sfs_lruhead;	/* least recently used */
+static struct sfs_buf *sfs_lrutail;	/* most recently used */
+static unsigned sfs_nbufs;		/* buffers allocated */
+static unsigned sfs_ndirty;		/* buffers dirty */
+static unsigned sfs_bufclock;		/* seconds of syncer time */
+static bool sfs_syncer_running;
+
+////////////////////////////////////////////////////////////
+// Hash and LRU list
+
+static
+unsigned
+sfs_buf_hash(struct device *dev, daddr_t block)
+{
+	return ((uintptr_t)dev / sizeof(void *) + block) % SFS_BUFHASH;
+}
+
+static
+struct sfs_buf *
+sfs_buf_lookup(struct device *dev, daddr_t block)
+{
+	struct sfs_buf *b;
+
+	b = sfs_bufhash[sfs_buf_hash(dev, block)];
+	while (b != NULL) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+		b = b->b_hashnext;
+	}
+	return NULL;
+}
+
+static
+void
+sfs_buf_hashadd(struct sfs_buf *b)
+{
+	unsigned h;
+
+	h = sfs_buf_hash(b->b_dev, b->b_block);
+	b->b_hashnext = sfs_bufhash[h];
+	sfs_bufhash[h] = b;
+}
+
+static
+void
+sfs_buf_hashrem(struct sfs_buf *b)
+{
+	struct sfs_buf **bp;
+
+	bp = &sfs_bufhash[sfs_buf_hash(b->b_dev, b->b_block)];
+	while (*bp != b) {
+		KASSERT(*bp != NULL);
+		bp = &(*bp)->b_hashnext;
+	}
+	*bp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+void
+sfs_buf_lruadd(struct sfs_buf *b)
+{
+	b->b_lrunext = NULL;
+	b->b_lruprev = sfs_lrutail;
+	if (sfs_lrutail != NULL) {
+		sfs_lrutail->b_lrunext = b;
+	}
+	else {
+		sfs_lruhead = b;
+	}
+	sfs_lrutail = b;
+}
+
+static
+void
+sfs_buf_lrurem(struct sfs_buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		sfs_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		sfs_lrutail = b->b_lruprev;
+	}
+	b->b_lrunext = b->b_lruprev = NULL;
+}
+
+////////////////////////////////////////////////////////////
+// Block I/O
+
+static
+int
+sfs_buf_io(struct sfs_buf *b, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+
+	SFSUIO(&iov, &ku, b->b_data, b->b_block, rw);
+	return sfs_rwblock(b->b_fs, &ku);
+}
+
+/*
+ * Write a dirty buffer back to disk.
+ */
+static
+int
+sfs_buf_writeout(struct sfs_buf *b)
+{
+	int result;
+
+	KASSERT(b->b_valid);
+	KASSERT(b->b_dirty);
+
+	result = sfs_buf_io(b, UIO_WRITE);
+	if (result) {
+		return result;
+	}
+	b->b_dirty = false;
+	sfs_ndirty--;
+	return 0;
+}
+
+/*
+ * Start asynchronous I/O on a buffer.
+ */
+static
+int
+sfs_buf_start(struct sfs_buf *b, bool write)
+{
+	int result;
+
+	KASSERT(!b->b_busy);
+
+	b->b_req.dr_block = b->b_block;
+	b->b_req.dr_nblocks = 1;
+	b->b_req.dr_write = write;
+	b->b_req.dr_data = b->b_data;
+	b->b_req.dr_done = NULL;
+	b->b_req.dr_arg = NULL;
+	result = dev_submit(b->b_dev, &b->b_req);
+	if (result) {
+		return result;
+	}
+	b->b_busy = true;
+	return 0;
+}
+
+/*
+ * Wait for asynchronous I/O on a buffer, if any, and update its
+ * state. A failed read leaves it invalid; a failed write leaves it
+ * dirty.
+ */
+static
+int
+sfs_buf_settle(struct sfs_buf *b)
+{
+	int result;
+
+	if (!b->b_busy) {
+		return 0;
+	}
+	result = dev_wait(&b->b_req);
+	b->b_busy = false;
+
+	if (b->b_req.dr_write) {
+		if (result == 0) {
+			b->b_dirty = false;
+			sfs_ndirty--;
+		}
+	}
+	else {
+		b->b_valid = (result == 0);
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// Allocation
+
+/*
+ * Get a buffer to use for a block not in the cache: a new one if
+ * we're under the limit or everything is pinned, otherwise the least
+ * recently used one, written back first if need be.
+ */
+static
+int
+sfs_buf_alloc(struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int result;
+
+	if (sfs_nbufs < SFS_NBUFS || sfs_lruhead == NULL) {
+		b = kmalloc(sizeof(*b));
+		if (b == NULL) {
+			if (sfs_lruhead == NULL) {
+				return ENOMEM;
+			}
+			/* fall through and recycle one instead */
+		}
+		else {
+			sfs_nbufs++;
+			b->b_busy = false;
+			b->b_hashnext = NULL;
+			b->b_lrunext = b->b_lruprev = NULL;
+			*ret = b;
+			return 0;
+		}
+	}
+
+	b = sfs_lruhead;
+	KASSERT(b->b_pincount == 0);
+	sfs_buf_settle(b);
+	if (b->b_dirty) {
+		result = sfs_buf_writeout(b);
+		if (result) {
+			return result;
+		}
+	}
+	sfs_buf_lrurem(b);
+	sfs_buf_hashrem(b);
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Common code for sfs_buf_read and sfs_buf_get.
+ */
+static
+int
+sfs_buf_fetch(struct sfs_fs *sfs, daddr_t block, bool doread,
+	      struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	b = sfs_buf_lookup(sfs->sfs_device, block);
+	if (b != NULL) {
+		KASSERT(b->b_fs == sfs);
+		sfs_buf_settle(b);
+		if (b->b_pincount == 0) {
+			sfs_buf_lrurem(b);
+		}
+		b->b_pincount++;
+	}
+	else {
+		result = sfs_buf_alloc(&b);
+		if (result) {
+			return result;
+		}
+		b->b_fs = sfs;
+		b->b_dev = sfs->sfs_device;
+		b->b_block = block;
+		b->b_valid = false;
+		b->b_dirty = false;
+		b->b_pincount = 1;
+		sfs_buf_hashadd(b);
+	}
+
+	if (doread && !b->b_valid) {
+		result = sfs_buf_io(b, UIO_READ);
+		if (result) {
+			sfs_buf_release(b);
+			return result;
+		}
+		b->b_valid = true;
+	}
+
+	*ret = b;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Interface
+
+/*
+ * Get block BLOCK of SFS, reading it in if it isn't cached. The
+ * buffer is pinned until released.
+ */
+int
+sfs_buf_read(struct sfs_fs *sfs, daddr_t block, struct sfs_buf **ret)
+{
+	return sfs_buf_fetch(sfs, block, true, ret);
+}
+
+/*
+ * Get block BLOCK of SFS without reading it in. Unless it was already
+ * cached the contents are garbage; the caller must fill in the whole
+ * block and call sfs_buf_dirty, or call sfs_buf_invalidate.
+ */
+int
+sfs_buf_get(struct sfs_fs *sfs, daddr_t block, struct sfs_buf **ret)
+{
+	return sfs_buf_fetch(sfs, block, false, ret);
+}
+
+/*
+ * Get a pointer to a buffer's data.
+ */
+void *
+sfs_buf_data(struct sfs_buf *b)
+{
+	KASSERT(b->b_pincount > 0);
+	return b->b_data;
+}
+
+/*
+ * Check whether a buffer's contents are meaningful. A buffer from
+ * sfs_buf_get is valid only if the block was already cached.
+ */
+bool
+sfs_buf_valid(struct sfs_buf *b)
+{
+	KASSERT(b->b_pincount > 0);
+	return b->b_valid;
+}
+
+/*
+ * Mark a buffer modified; it will be written back later.
+ */
+void
+sfs_buf_dirty(struct sfs_buf *b)
+{
+	KASSERT(b->b_pincount > 0);
+	b->b_valid = true;
+	if (!b->b_dirty) {
+		b->b_dirty = true;
+		b->b_dirtytime = sfs_bufclock;
+		sfs_ndirty++;
+	}
+}
+
+/*
+ * Discard a buffer's contents, e.g. after failing partway through
+ * filling a buffer from sfs_buf_get. The block will be read from disk
+ * again next time.
+ */
+void
+sfs_buf_invalidate(struct sfs_buf *b)
+{
+	KASSERT(b->b_pincount > 0);
+	if (b->b_dirty) {
+		b->b_dirty = false;
+		sfs_ndirty--;
+	}
+	b->b_valid = false;
+}
+
+/*
+ * Unpin a buffer.
+ */
+void
+sfs_buf_release(struct sfs_buf *b)
+{
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(b->b_pincount > 0);
+
+	b->b_pincount--;
+	if (b->b_pincount == 0) {
+		sfs_buf_lruadd(b);
+	}
+}
+
+/*
+ * Start reading NBLOCKS consecutive disk blocks starting at BLOCK
+ * into the cache, without waiting. Blocks already cached or on their
+ * way are skipped. This is advisory: errors are ignored, as whoever
+ * actually wants the data will read it again and see them.
+ */
+void
+sfs_buf_readahead(struct sfs_fs *sfs, daddr_t block, unsigned nblocks)
+{
+	struct sfs_buf *b;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<nblocks; i++) {
+		b = sfs_buf_lookup(sfs->sfs_device, block + i);
+		if (b != NULL && (b->b_valid || b->b_busy)) {
+			continue;
+		}
+		if (sfs_buf_get(sfs, block + i, &b)) {
+			break;
+		}
+		if (sfs_buf_start(b, false)) {
+			sfs_buf_release(b);
+			break;
+		}
+		sfs_buf_release(b);
+	}
+}
+
+/*
+ * Forget any cached contents of block BLOCK of SFS, which has just
+ * been freed, so it isn't written back for nothing.
+ */
+void
+sfs_buf_discard(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_buf *b;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	b = sfs_buf_lookup(sfs->sfs_device, block);
+	if (b != NULL) {
+		KASSERT(b->b_pincount == 0);
+		sfs_buf_settle(b);
+		if (b->b_dirty) {
+			b->b_dirty = false;
+			sfs_ndirty--;
+		}
+		b->b_valid = false;
+	}
+}
+
+/*
+ * Order buffers by device, then block number.
+ */
+static
+bool
+sfs_buf_before(struct sfs_buf *a, struct sfs_buf *b)
+{
+	if (a->b_dev != b->b_dev) {
+		return (uintptr_t)a->b_dev < (uintptr_t)b->b_dev;
+	}
+	return a->b_block < b->b_block;
+}
+
+/*
+ * Write back dirty buffers belonging to SFS (or to every volume, if
+ * SFS is NULL) that have been dirty at least MINAGE seconds. They are
+ * all queued in block order, then waited for.
+ */
+static
+int
+sfs_buf_flush(struct sfs_fs *sfs, unsigned minage)
+{
+	/* Protected by the biglock like everything else */
+	static struct sfs_buf *list[SFS_NBUFS];
+
+	struct sfs_buf *b;
+	unsigned i, j, n, started;
+	bool more;
+	int result, ret;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	do {
+		/* Collect candidates, up to a listful at a time */
+		n = 0;
+		more = false;
+		for (i=0; i<SFS_BUFHASH && !more; i++) {
+			for (b = sfs_bufhash[i]; b != NULL; b = b->b_hashnext) {
+				if (!b->b_dirty || b->b_busy ||
+				    (sfs != NULL && b->b_fs != sfs) ||
+				    sfs_bufclock - b->b_dirtytime < minage) {
+					continue;
+				}
+				if (n == SFS_NBUFS) {
+					more = true;
+					break;
+				}
+				list[n++] = b;
+			}
+		}
+
+		/* Insertion sort; the list is short */
+		for (i=1; i<n; i++) {
+			b = list[i];
+			for (j=i; j>0 && sfs_buf_before(b, list[j-1]); j--) {
+				list[j] = list[j-1];
+			}
+			list[j] = b;
+		}
+
+		/* Queue them all, then wait for them all */
+		ret = 0;
+		for (started=0; started<n; started++) {
+			ret = sfs_buf_start(list[started], true);
+			if (ret) {
+				break;
+			}
+		}
+		for (i=0; i<started; i++) {
+			result = sfs_buf_settle(list[i]);
+			if (result && ret == 0) {
+				ret = result;
+			}
+		}
+		if (ret) {
+			return ret;
+		}
+	} while (more);
+
+	return 0;
+}
+
+/*
+ * Write back all dirty buffers belonging to SFS.
+ */
+int
+sfs_buf_sync(struct sfs_fs *sfs)
+{
+	return sfs_buf_flush(sfs, 0);
+}
+
+/*
+ * Throw away all buffers belonging to SFS, which is being unmounted
+ * and has already been synced.
+ */
+void
+sfs_buf_purge(struct sfs_fs *sfs)
+{
+	struct sfs_buf *b, **bp;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<SFS_BUFHASH; i++) {
+		bp = &sfs_bufhash[i];
+		while ((b = *bp) != NULL) {
+			if (b->b_fs != sfs) {
+				bp = &b->b_hashnext;
+				continue;
+			}
+			KASSERT(b->b_pincount == 0);
+			sfs_buf_settle(b);
+			KASSERT(!b->b_dirty);
+			*bp = b->b_hashnext;
+			sfs_buf_lrurem(b);
+			kfree(b);
+			sfs_nbufs--;
+		}
+	}
+}
+
+/*
+ * The syncer thread.
+ */
+static
+void
+sfs_syncer(void *data1, unsigned long data2)
+{
+	int result;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		clocksleep(1);
+
+		vfs_biglock_acquire();
+		sfs_bufclock++;
+		if (sfs_ndirty > SFS_DIRTYMAX) {
+			result = sfs_buf_flush(NULL, 0);
+		}
+		else {
+			result = sfs_buf_flush(NULL, SFS_SYNCAGE);
+		}
+		vfs_biglock_release();
+
+		if (result) {
+			/* The buffers stay dirty; we'll try again */
+			kprintf("sfs: syncer: %s\n", strerror(result));
+		}
+	}
+}
+
+/*
+ * Start the syncer thread, if it isn't already running. Called at
+ * mount time.
+ */
+int
+sfs_buf_startsyncer(void)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_syncer_running) {
+		return 0;
+	}
+	result = thread_fork("sfs syncer", NULL, sfs_syncer, NULL, 0);
+	if (result) {
+		return result;
+	}
+	sfs_syncer_running = true;
+	return 0;
+}
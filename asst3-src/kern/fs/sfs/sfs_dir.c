@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <vfs.h>
 #include <sfs.h>
+#include <namecache.h>
 #include "sfsprivate.h"
 
 /*
@@ -99,14 +100,31 @@ sfs_dir_nentries(struct sfs_vnode *sv)
  * Search a directory for a particular filename in a directory, and
  * return its inode number, its slot, and/or the slot number of an
  * empty directory slot if one is found.
+ *
+ * If only the inode number is wanted, the name cache may be able to
+ * answer without reading the directory; otherwise we record what we
+ * find there.
  */
 int
 sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_direntry tsd;
+	uint32_t foundino;
 	int found, nentries, i, result;
 
+	if (slot == NULL && emptyslot == NULL) {
+		switch (namecache_lookup(&sv->sv_absvn, name, &foundino)) {
+		    case NC_FOUND:
+			if (ino != NULL) {
+				*ino = foundino;
+			}
+			return 0;
+		    case NC_NOTFOUND:
+			return ENOENT;
+		}
+	}
+
 	nentries = sfs_dir_nentries(sv);
 
 	/* For each slot... */
@@ -133,6 +151,7 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 				KASSERT(found==0);
 
 				found = 1;
+				foundino = tsd.sfd_ino;
 				if (slot != NULL) {
 					*slot = i;
 				}
@@ -143,7 +162,12 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		}
 	}
 
-	return found ? 0 : ENOENT;
+	if (!found) {
+		namecache_enter_negative(&sv->sv_absvn, name);
+		return ENOENT;
+	}
+	namecache_enter(&sv->sv_absvn, name, foundino);
+	return 0;
 }
 
 /*
@@ -185,24 +209,38 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 		*slot = emptyslot;
 	}
 
-	/* Write the entry. */
-	return sfs_writedir(sv, emptyslot, &sd);
+	/* Write the entry, and tell the name cache. */
+	result = sfs_writedir(sv, emptyslot, &sd);
+	if (result) {
+		namecache_remove(&sv->sv_absvn, name);
+		return result;
+	}
+	namecache_enter(&sv->sv_absvn, name, ino);
+	return 0;
 }
 
 /*
- * Unlink a name in a directory, by slot number.
+ * Unlink a name in a directory, by slot number. NAME must be the name
+ * in that slot; it's needed to update the name cache.
  */
 int
-sfs_dir_unlink(struct sfs_vnode *sv, int slot)
+sfs_dir_unlink(struct sfs_vnode *sv, const char *name, int slot)
 {
 	struct sfs_direntry sd;
+	int result;
 
 	/* Initialize a suitable directory entry... */
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = SFS_NOINO;
 
 	/* ... and write it */
-	return sfs_writedir(sv, slot, &sd);
+	result = sfs_writedir(sv, slot, &sd);
+	if (result) {
+		namecache_remove(&sv->sv_absvn, name);
+		return result;
+	}
+	namecache_enter_negative(&sv->sv_absvn, name);
+	return 0;
 }
 
 /*
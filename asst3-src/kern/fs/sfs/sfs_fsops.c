@@ -114,11 +114,15 @@ sfs_sync_vnodes(struct sfs_fs *sfs)
 {
 	unsigned i, num;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
+	/*
+	 * Go over the array of loaded vnodes, syncing as we go. This
+	 * only copies the inodes into the buffer cache; sfs_sync
+	 * flushes that afterwards, once for all of them.
+	 */
 	num = vnodearray_num(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
 		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		sfs_sync_inode(v->vn_data);
 	}
 	return 0;
 }
@@ -215,6 +219,13 @@ sfs_sync(struct fs *fs)
 		return result;
 	}
 
+	/* Write back everything dirty in the buffer cache. */
+	result = sfs_buf_sync(sfs);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* If the free block map needs to be written, write it. */
 	result = sfs_sync_freemap(sfs);
 	if (result) {
@@ -290,6 +301,9 @@ sfs_unmount(struct fs *fs)
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
+	/* Drop our blocks from the buffer cache; they're all clean. */
+	sfs_buf_purge(sfs);
+
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
 
@@ -464,6 +478,15 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return result;
 	}
 
+	/* Make sure someone is writing back the buffer cache */
+	result = sfs_buf_startsyncer();
+	if (result) {
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
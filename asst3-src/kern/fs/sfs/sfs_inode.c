@@ -41,20 +41,24 @@
 
 
 /*
- * Write an on-disk inode structure back out to disk.
+ * Write an on-disk inode structure back out to its block in the
+ * buffer cache. (It reaches the disk when the buffer does.)
  */
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	int result;
 
 	if (sv->sv_dirty) {
-		result = sfs_writeblock(sfs, sv->sv_ino, &sv->sv_i,
-					sizeof(sv->sv_i));
+		result = sfs_buf_get(sfs, sv->sv_ino, &buf);
 		if (result) {
 			return result;
 		}
+		memcpy(sfs_buf_data(buf), &sv->sv_i, sizeof(sv->sv_i));
+		sfs_buf_dirty(buf);
+		sfs_buf_release(buf);
 		sv->sv_dirty = false;
 	}
 	return 0;
@@ -80,18 +84,11 @@ sfs_reclaim(struct vnode *v)
 	 * decision was made to reclaim it. (You must also synchronize
 	 * this with sfs_loadvnode.)
 	 */
-	spinlock_acquire(&v->vn_countlock);
-	if (v->vn_refcount != 1) {
-
-		/* consume the reference VOP_DECREF gave us */
-		KASSERT(v->vn_refcount>1);
-		v->vn_refcount--;
-
-		spinlock_release(&v->vn_countlock);
+	if (!vnode_reclaimable(v)) {
+		/* it consumed the reference VOP_DECREF gave us */
 		vfs_biglock_release();
 		return EBUSY;
 	}
-	spinlock_release(&v->vn_countlock);
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
@@ -152,6 +149,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 {
 	struct vnode *v;
 	struct sfs_vnode *sv;
+	struct sfs_buf *buf;
 	const struct vnode_ops *ops;
 	unsigned i, num;
 	int result;
@@ -196,15 +194,22 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	}
 
 	/* Read the block the inode is in */
-	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
+	result = sfs_buf_read(sfs, ino, &buf);
 	if (result) {
 		kfree(sv);
 		return result;
 	}
+	memcpy(&sv->sv_i, sfs_buf_data(buf), sizeof(sv->sv_i));
+	sfs_buf_release(buf);
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* No read history yet */
+	sv->sv_ranext = 0;
+	sv->sv_rahigh = 0;
+	sv->sv_rawindow = 0;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out by sfs_balloc and
@@ -53,9 +53,9 @@
  */
 
 /*
- * Read or write a block, retrying I/O errors.
+ * Read or write a block, retrying I/O errors. This goes straight to
+ * the disk; the buffer cache (sfs_cache.c) sits on top of it.
  */
-static
 int
 sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 {
@@ -102,7 +102,8 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 }
 
 /*
- * Read a block.
+ * Read a block, bypassing the buffer cache. Only for the superblock
+ * and freemap.
  */
 int
 sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
@@ -117,7 +118,8 @@ sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 }
 
 /*
- * Write a block.
+ * Write a block, bypassing the buffer cache. Only for the superblock
+ * and freemap.
  */
 int
 sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
@@ -131,6 +133,124 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 	return sfs_rwblock(sfs, &ku);
 }
 
+////////////////////////////////////////////////////////////
+//
+// Read-ahead
+
+/* Largest read-ahead window, in blocks. */
+#define SFS_RAMAX	32
+
+/*
+ * Start prefetching file blocks [FIRST, LIMIT) of SV into the buffer
+ * cache, a run of blocks that are consecutive on disk at a time.
+ * Holes are skipped.
+ */
+static
+void
+sfs_prefetch(struct sfs_vnode *sv, uint32_t first, uint32_t limit)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t diskblock, runstart;
+	uint32_t fileblock;
+	unsigned runlen;
+
+	runstart = 0;
+	runlen = 0;
+	for (fileblock = first; fileblock < limit; fileblock++) {
+		if (sfs_bmap(sv, fileblock, false, &diskblock)) {
+			break;
+		}
+		if (runlen > 0 && diskblock == runstart + runlen) {
+			runlen++;
+			continue;
+		}
+		if (runlen > 0) {
+			sfs_buf_readahead(sfs, runstart, runlen);
+		}
+		runstart = diskblock;
+		runlen = (diskblock != 0) ? 1 : 0;
+	}
+	if (runlen > 0) {
+		sfs_buf_readahead(sfs, runstart, runlen);
+	}
+}
+
+/*
+ * Keep read-ahead going for a read that is now at file block POS and
+ * wants blocks up to (not including) END read ahead. At most
+ * SFS_RAMAX blocks past POS are requested, so a long read doesn't make
+ * the buffer cache recycle blocks it read ahead itself before they're
+ * used; more are requested as the read advances, half a window at a
+ * time so each request can still be a decent-sized run.
+ */
+static
+void
+sfs_readahead_more(struct sfs_vnode *sv, uint32_t pos, uint32_t end)
+{
+	uint32_t first, limit;
+
+	limit = pos + SFS_RAMAX;
+	if (limit > end) {
+		limit = end;
+	}
+	first = sv->sv_rahigh > pos ? sv->sv_rahigh : pos;
+	if (first >= limit) {
+		return;
+	}
+	if (limit - first < SFS_RAMAX / 2 && limit < end) {
+		/* Wait until there's more to ask for */
+		return;
+	}
+	sfs_prefetch(sv, first, limit);
+	sv->sv_rahigh = limit;
+}
+
+/*
+ * Called before a read of UIO (already trimmed at EOF). Reads that
+ * pick up where the last one left off grow the read-ahead window,
+ * doubling up to SFS_RAMAX blocks; anything else resets it to zero.
+ * The blocks being read plus the window beyond them are to be read
+ * ahead, so they proceed while earlier blocks are copied out. Returns
+ * the end of that range, for sfs_readahead_more as the read goes on.
+ * Blocks already read ahead on a previous call aren't looked at again.
+ */
+static
+uint32_t
+sfs_readahead(struct sfs_vnode *sv, struct uio *uio)
+{
+	uint32_t first, last, end, fileblocks;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	KASSERT(uio->uio_resid > 0);
+
+	first = uio->uio_offset / SFS_BLOCKSIZE;
+	last = (uio->uio_offset + uio->uio_resid - 1) / SFS_BLOCKSIZE;
+
+	/* Small sequential reads may start in the block the last one ended in */
+	if (sv->sv_ranext > 0 &&
+	    (first == sv->sv_ranext || first + 1 == sv->sv_ranext)) {
+		if (sv->sv_rawindow == 0) {
+			sv->sv_rawindow = 4;
+		}
+		else if (sv->sv_rawindow < SFS_RAMAX) {
+			sv->sv_rawindow *= 2;
+		}
+	}
+	else {
+		sv->sv_rawindow = 0;
+		sv->sv_rahigh = 0;
+	}
+	sv->sv_ranext = last + 1;
+
+	fileblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	end = last + 1 + sv->sv_rawindow;
+	if (end > fileblocks) {
+		end = fileblocks;
+	}
+	sfs_readahead_more(sv, first, end);
+	return end;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
@@ -150,16 +270,9 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
+	char *iobuf;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -169,9 +282,6 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
@@ -184,40 +294,33 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read as zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block from the buffer cache.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = sfs_buf_read(sfs, diskblock, &buf);
 	if (result) {
 		return result;
 	}
+	iobuf = sfs_buf_data(buf);
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the block will be written back later.
 	 */
+	result = uiomove(iobuf+skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		/* Even if it failed partway; the buffer has changed */
+		sfs_buf_dirty(buf);
 	}
 
-	return 0;
+	sfs_buf_release(buf);
+	return result;
 }
 
 /*
@@ -228,14 +331,12 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
+	bool wasvalid;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -257,31 +358,40 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
-	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-
-	result = sfs_rwblock(sfs, uio);
 
 	/*
-	 * Now, restore the original uio_offset and uio_resid and update
-	 * them by the amount of I/O done.
+	 * Go through the buffer cache. For a write the whole block is
+	 * being replaced, so there's no need to read it in first.
 	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
+	if (uio->uio_rw == UIO_READ) {
+		result = sfs_buf_read(sfs, diskblock, &buf);
+	}
+	else {
+		result = sfs_buf_get(sfs, diskblock, &buf);
+	}
+	if (result) {
+		return result;
+	}
 
+	wasvalid = sfs_buf_valid(buf);
+	result = uiomove(sfs_buf_data(buf), SFS_BLOCKSIZE, uio);
+	if (uio->uio_rw == UIO_WRITE) {
+		if (result && !wasvalid) {
+			/* Partially filled with garbage after it; junk */
+			sfs_buf_invalidate(buf);
+		}
+		else {
+			/*
+			 * Keep a partial write over cached contents:
+			 * they may hold an earlier write that hasn't
+			 * gone to disk yet.
+			 */
+			sfs_buf_dirty(buf);
+		}
+	}
+
+	sfs_buf_release(buf);
 	return result;
 }
 
@@ -295,6 +405,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t nblocks, i;
 	int result = 0;
 	uint32_t origresid, extraresid = 0;
+	uint32_t raend = 0;
 
 	origresid = uio->uio_resid;
 
@@ -317,6 +428,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 			KASSERT(uio->uio_resid > extraresid);
 			uio->uio_resid -= extraresid;
 		}
+
+		if (uio->uio_resid > 0) {
+			raend = sfs_readahead(sv, uio);
+		}
 	}
 
 	/*
@@ -353,6 +468,11 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
 	for (i=0; i<nblocks; i++) {
+		if (raend > 0) {
+			sfs_readahead_more(sv,
+					   uio->uio_offset / SFS_BLOCKSIZE,
+					   raend);
+		}
 		result = sfs_blockio(sv, uio);
 		if (result) {
 			goto out;
@@ -407,6 +527,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	   enum uio_rw rw)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
+	char *metaiobuf;
 	off_t endpos;
 	uint32_t vnblock;
 	uint32_t blockoffset;
@@ -414,18 +536,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	bool doalloc;
 	int result;
 
-	/*
-	 * I/O buffer for metadata ops.
-	 *
-	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
-	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
-
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Figure out which block of the vnode (directory, whatever) this is */
 	vnblock = actualpos / SFS_BLOCKSIZE;
 	blockoffset = actualpos % SFS_BLOCKSIZE;
@@ -446,11 +556,12 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	/* Get the block */
+	result = sfs_buf_read(sfs, diskblock, &buf);
 	if (result) {
 		return result;
 	}
+	metaiobuf = sfs_buf_data(buf);
 
 	if (rw == UIO_READ) {
 		/* Copy out the selected region */
@@ -460,12 +571,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		/* Update the selected region */
 		memcpy(metaiobuf + blockoffset, data, len);
 
-		/* Write the block back */
-		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
-		if (result) {
-			return result;
-		}
+		/* It'll be written back later */
+		sfs_buf_dirty(buf);
 
 		/* Update the vnode size if needed */
 		endpos = actualpos + len;
@@ -476,5 +583,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	}
 
 	/* Done */
+	sfs_buf_release(buf);
 	return 0;
 }
@@ -226,6 +226,14 @@ sfs_fsync(struct vnode *v)
 
 	vfs_biglock_acquire();
 	result = sfs_sync_inode(sv);
+	if (result == 0) {
+		/*
+		 * Push the inode and file's blocks out of the buffer
+		 * cache. We don't track which buffers belong to which
+		 * file, so this writes everything dirty on the volume.
+		 */
+		result = sfs_buf_sync(sv->sv_absvn.vn_fs->fs_data);
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -406,7 +414,7 @@ sfs_remove(struct vnode *dir, const char *name)
 	}
 
 	/* Erase its directory entry. */
-	result = sfs_dir_unlink(sv, slot);
+	result = sfs_dir_unlink(sv, name, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
@@ -471,7 +479,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_dirty = true;
 
 	/* Unlink the old slot */
-	result = sfs_dir_unlink(sv, slot1);
+	result = sfs_dir_unlink(sv, n1, slot1);
 	if (result) {
 		goto puke_harder;
 	}
@@ -494,7 +502,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/*
 	 * Error recovery: try to undo what we already did
 	 */
-	result2 = sfs_dir_unlink(sv, slot2);
+	result2 = sfs_dir_unlink(sv, n2, slot2);
 	if (result2) {
 		kprintf("sfs: %s: rename: %s\n",
 			sfs->sfs_sb.sb_volname, strerror(result));
@@ -47,6 +47,21 @@ int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 
+/* Functions in sfs_cache.c */
+struct sfs_buf;
+int sfs_buf_read(struct sfs_fs *sfs, daddr_t block, struct sfs_buf **ret);
+int sfs_buf_get(struct sfs_fs *sfs, daddr_t block, struct sfs_buf **ret);
+void *sfs_buf_data(struct sfs_buf *buf);
+bool sfs_buf_valid(struct sfs_buf *buf);
+void sfs_buf_dirty(struct sfs_buf *buf);
+void sfs_buf_invalidate(struct sfs_buf *buf);
+void sfs_buf_release(struct sfs_buf *buf);
+void sfs_buf_discard(struct sfs_fs *sfs, daddr_t block);
+void sfs_buf_readahead(struct sfs_fs *sfs, daddr_t block, unsigned nblocks);
+int sfs_buf_sync(struct sfs_fs *sfs);
+void sfs_buf_purge(struct sfs_fs *sfs);
+int sfs_buf_startsyncer(void);
+
 /* Functions in sfs_bmap.c */
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		daddr_t *diskblock);
@@ -57,7 +72,7 @@ int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot);
 int sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino,
 		int *slot);
-int sfs_dir_unlink(struct sfs_vnode *sv, int slot);
+int sfs_dir_unlink(struct sfs_vnode *sv, const char *name, int slot);
 int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
@@ -71,6 +86,7 @@ int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
 
 /* Functions in sfs_io.c */
+int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_io(struct sfs_vnode *sv, struct uio *uio);
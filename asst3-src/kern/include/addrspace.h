@@ -41,6 +41,8 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct lock;
+struct rwlock;
 
 struct region {     
     vaddr_t vbase;
@@ -69,11 +71,24 @@ struct addrspace {
 #else
         /* Put stuff here for your VM system */
         
-        /* Regions map of this address space. */
+        /* Regions map of this address space, and its lock. Faults
+         * only read the list so they take the lock shared; defining
+         * regions or changing their permissions takes it exclusive.
+         */
         struct region *regions;
+        struct rwlock *regionlock;
+
+        /* Bitmap of user thread stack regions that have been defined
+         * (see as_define_threadstack); protected by regionlock.
+         */
+        uint32_t threadstacks;
         
-        /* Root pagetable. */
+        /* Root pagetable, and the lock that lets threads sharing
+         * this address space fault concurrently without filling
+         * in the same entry twice.
+         */
         paddr_t **ptable;
+        struct lock *ptlock;
 #endif
 };
 
@@ -114,6 +129,11 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_threadstack - set up the stack region for user thread
+ *                number SLOT (slot 0 is the regular stack), unless an
+ *                earlier thread in that slot already did. Hands back
+ *                the initial stack pointer for the thread.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -132,6 +152,8 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned slot,
+                                        vaddr_t *initstackptr);
 
 
 /*
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Atomic operations on integers in memory, for counters and reference
+ * counts that would otherwise need a spinlock just to change an int.
+ *
+ * atomic_add adds DELTA to *P and returns the new value.
+ *
+ * atomic_cas sets *P to NEWVAL if it is OLDVAL, and returns true if
+ * it did.
+ *
+ * atomic_add_unless adds DELTA to *P unless *P is UNLESS, and returns
+ * true if it did. VOP_DECREF uses this to drop a reference that is
+ * not the last one.
+ *
+ * atomic_inc_not_zero increments *P unless it is zero, and returns
+ * true if it did. This is how to take a reference to an object found
+ * through some table, whose last reference may be going away at the
+ * same time.
+ *
+ * atomic_dec_and_test decrements *P and returns true if that made it
+ * zero.
+ *
+ * atomic_add and atomic_cas by themselves are not memory barriers.
+ * The others include full barriers, like spinlock operations do, so
+ * that everything done with a reference happens before it is dropped
+ * and the object freed.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+ATOMIC_INLINE int atomic_add(volatile int *p, int delta);
+ATOMIC_INLINE bool atomic_cas(volatile int *p, int oldval, int newval);
+ATOMIC_INLINE bool atomic_add_unless(volatile int *p, int delta, int unless);
+ATOMIC_INLINE bool atomic_inc_not_zero(volatile int *p);
+ATOMIC_INLINE bool atomic_dec_and_test(volatile int *p);
+
+/* Get the machine-dependent implementation of atomic_add and atomic_cas. */
+#include <machine/atomic.h>
+
+#include <membar.h>
+
+ATOMIC_INLINE
+bool
+atomic_add_unless(volatile int *p, int delta, int unless)
+{
+	int val;
+
+	membar_any_any();
+	do {
+		val = *p;
+		if (val == unless) {
+			return false;
+		}
+	} while (!atomic_cas(p, val, val + delta));
+	membar_any_any();
+	return true;
+}
+
+ATOMIC_INLINE
+bool
+atomic_inc_not_zero(volatile int *p)
+{
+	return atomic_add_unless(p, 1, 0);
+}
+
+ATOMIC_INLINE
+bool
+atomic_dec_and_test(volatile int *p)
+{
+	int val;
+
+	membar_any_any();
+	val = atomic_add(p, -1);
+	membar_any_any();
+	return val == 0;
+}
+
+#endif /* _ATOMIC_H_ */
@@ -34,6 +34,14 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <cpustat.h>
+#include <schedstat.h>
+#include "opt-lockstat.h"
+#include "opt-trace.h"
+#include "opt-prof.h"
+
+struct timer;	/* from <timer.h> */
+struct lockstat_table;	/* from <lockstat.h> */
 
 
 /*
@@ -58,9 +66,29 @@ struct cpu {
 	 * Accessed only by this cpu.
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
+	struct thread *c_handoff;	/* Thread leaving for another cpu */
+	struct thread *c_idlethread;	/* Runs when nothing else can */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+#if OPT_LOCKSTAT
+	struct lockstat_table *c_lockstat; /* Lock statistics */
+#endif
+#if OPT_TRACE
+	struct trace_ring *c_trace;	/* Trace records */
+#endif
+#if OPT_PROF
+	struct prof_table *c_prof;	/* Profile samples */
+	vaddr_t c_intrpc;		/* PC interrupted by the last interrupt */
+	bool c_intruser;		/* ...and whether it was in user mode */
+#endif
+
+	/*
+	 * Written only by this cpu, with atomic_add; read by anyone.
+	 * See <cpustat.h>.
+	 */
+	unsigned c_stats[NCPUSTATS];	/* Event counters */
 
 	/*
 	 * Accessed by other cpus.
@@ -69,6 +97,22 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+#if OPT_SCHEDSTAT
+	struct schedstat c_schedstat;	/* Scheduler statistics */
+#endif
+
+	/*
+	 * Accessed by other cpus.
+	 * Protected by the timer lock.
+	 *
+	 * c_timers is the root of a heap of pending timers (see
+	 * <timer.h>); c_timer_running is the timer whose function is
+	 * currently being called, if any.
+	 */
+	struct timer *c_timers;		/* Pending timers */
+	struct timer *c_timer_running;	/* Timer now firing */
+	uint64_t c_nexthardclock;	/* When hardclock() is next due */
+	struct spinlock c_timers_lock;
 
 	/*
 	 * Accessed by other cpus.
@@ -107,6 +151,14 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Get the number of cpus, and the cpu with software number NUM. For
+ * gathering up per-cpu data; the set of cpus does not change once
+ * they have been started.
+ */
+unsigned cpu_numcpus(void);
+struct cpu *cpu_get(unsigned num);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _CPUSTAT_H_
+#define _CPUSTAT_H_
+
+/*
+ * Per-cpu event counters.
+ *
+ * Each cpu keeps its own array of counters (c_stats in struct cpu),
+ * so bumping one never touches a cache line another cpu is writing
+ * and never takes a lock. The increment is done with atomic_add, so
+ * it is safe from interrupt handlers (including hardclock) and
+ * against being preempted and migrated halfway through; in the
+ * latter case the event is charged to the old cpu, which is harmless
+ * since only the totals mean anything.
+ *
+ * Reading sums the counters across all cpus. The sum is not a
+ * snapshot -- other cpus keep counting while it is taken -- but each
+ * individual counter is read atomically. Counters are 32 bits per
+ * cpu and wrap; the totals are 64 bits.
+ *
+ * To add a counter, add it to the list below and to the name table
+ * in cpustat.c.
+ */
+
+#define CPUSTAT_SYSCALLS	0	/* System calls */
+#define CPUSTAT_VMFAULTS	1	/* TLB faults handled by vm_fault */
+#define CPUSTAT_SWITCHES	2	/* Context switches */
+#define CPUSTAT_INTERRUPTS	3	/* Hardware interrupts */
+#define CPUSTAT_DISKIO		4	/* Disk sectors transferred */
+#define CPUSTAT_NCHITS		5	/* Name cache hits (incl. negative) */
+#define CPUSTAT_NCMISSES	6	/* Name cache misses */
+#define NCPUSTATS		7
+
+/*
+ * cpustat_add - add N to counter WHICH on the current cpu.
+ * cpustat_inc - add one to counter WHICH on the current cpu.
+ * cpustat_get - return the total of counter WHICH over all cpus.
+ * cpustat_reset - zero all counters on all cpus.
+ * cpustat_dump - print all counters, per cpu and in total.
+ */
+void cpustat_add(unsigned which, unsigned n);
+#define cpustat_inc(which) cpustat_add(which, 1)
+uint64_t cpustat_get(unsigned which);
+void cpustat_reset(void);
+void cpustat_dump(void);
+
+#endif /* _CPUSTAT_H_ */
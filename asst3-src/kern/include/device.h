@@ -36,6 +36,8 @@
 
 
 struct uio;  /* in <uio.h> */
+struct devreq;
+struct pollset; /* in <poll.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -56,11 +58,16 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_submit - start an asynchronous request (optional; see below)
+ *      devop_poll - check readiness, as for vop_poll (optional; if not
+ *                   provided the device is always ready)
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	int (*devop_submit)(struct device *, struct devreq *);
+	int (*devop_poll)(struct device *, int events, struct pollset *);
 };
 
 /*
@@ -71,6 +78,50 @@ struct device_ops {
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
 
 
+/*
+ * Asynchronous block I/O.
+ *
+ * Fill in dr_block, dr_nblocks, dr_write and dr_data (a kernel
+ * buffer of dr_nblocks * d_blocksize bytes), and optionally dr_done
+ * and dr_arg, and pass the request to dev_submit. If dev_submit
+ * returns an error the request was not started. Otherwise it runs in
+ * the background; dev_poll tells whether it has finished, and
+ * dev_wait waits for it and returns its result. The request and its
+ * buffer must stay put until then.
+ *
+ * If set, dr_done is called when the request finishes, possibly from
+ * an interrupt handler, so it must not sleep.
+ *
+ * Drivers that can do I/O asynchronously provide devop_submit, and
+ * call devreq_complete from their interrupt handler when a request
+ * finishes. For other devices dev_submit does the I/O synchronously
+ * with devop_io.
+ */
+struct devreq {
+	daddr_t dr_block;		/* first block */
+	unsigned dr_nblocks;		/* number of blocks */
+	bool dr_write;			/* direction */
+	void *dr_data;			/* kernel buffer */
+	void (*dr_done)(struct devreq *, int result);
+	void *dr_arg;			/* for dr_done */
+
+	/* Results */
+	int dr_result;			/* errno */
+	volatile bool dr_complete;	/* finished */
+
+	/* For the driver's use */
+	struct devreq *dr_next;		/* queue link */
+	struct devreq *dr_chain;	/* requests merged behind this one */
+	unsigned dr_pos;		/* blocks transferred so far */
+	daddr_t dr_chainend;		/* block after the end of the chain */
+};
+
+int dev_submit(struct device *d, struct devreq *r);
+bool dev_poll(struct devreq *r);
+int dev_wait(struct devreq *r);
+void devreq_complete(struct devreq *r, int result);
+void devreq_bootstrap(void);
+
 /* Create vnode for a vfs-level device. */
 struct vnode *dev_create_vnode(struct device *dev);
 
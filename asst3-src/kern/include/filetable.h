@@ -48,14 +48,16 @@
  * or even to make it dynamic with the limit being user-settable. (See
  * setrlimit(2) on a Unix machine.)
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * On fork, the table is copied. Within a process the table is
+ * protected by a reader-writer lock: lookups (by far the most common
+ * operation) take it shared, and only calls that change which file is
+ * in which slot take it exclusive. filetable_get hands back its own
+ * reference to the openfile, so if one thread calls close() while
+ * another one is in the middle of e.g. read() using the same file
+ * handle, the read finishes on the file it started with.
  */
 struct filetable {
+	struct rwlock *ft_lock;
 	struct openfile *ft_openfiles[OPEN_MAX];
 };
 
@@ -68,7 +70,8 @@ struct filetable {
  * okfd -    Check if a file handle is in range.
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
- *           is not NULL.) Call put with the file returned from get.
+ *           is not NULL and is referenced until put.) Call put with
+ *           the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
  *           previously there.
@@ -108,8 +108,11 @@
  * Not very important at all.
  */
 
-/* Max number of iovec structures at once for readv/writev/preadv/pwritev */
-#define __IOV_MAX       1024
+/*
+ * Max number of iovec structures at once for readv/writev/preadv/pwritev.
+ * The kernel copies the array into one page, so this is a page's worth.
+ */
+#define __IOV_MAX       512
 
 
 #endif /* _KERN_LIMITS_H_ */
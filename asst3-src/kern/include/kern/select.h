@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_SELECT_H_
+#define _KERN_SELECT_H_
+
+/*
+ * Definitions for select(), for <sys/select.h>.
+ *
+ * An fd_set is a bitmap of file handles, one bit each, big enough
+ * for every handle a process can have open. FD_SETSIZE comes from
+ * __OPEN_MAX in <kern/limits.h>, which must be included first.
+ */
+
+#define FD_SETSIZE	__OPEN_MAX
+#define __NFDBITS	32
+
+typedef struct {
+	__u32 fds_bits[(FD_SETSIZE + __NFDBITS - 1) / __NFDBITS];
+} fd_set;
+
+#define FD_ZERO(set) \
+	do { \
+		unsigned __fdi; \
+		for (__fdi = 0; \
+		     __fdi < sizeof((set)->fds_bits) / sizeof(__u32); \
+		     __fdi++) { \
+			(set)->fds_bits[__fdi] = 0; \
+		} \
+	} while (0)
+#define FD_SET(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] |= (__u32)1 << ((fd) % __NFDBITS))
+#define FD_CLR(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] &= ~((__u32)1 << ((fd) % __NFDBITS)))
+#define FD_ISSET(fd, set) \
+	(((set)->fds_bits[(fd) / __NFDBITS] >> ((fd) % __NFDBITS)) & 1)
+
+
+#endif /* _KERN_SELECT_H_ */
@@ -36,6 +36,7 @@
 
 /* Get the limit values, which are exported to userland with private names. */
 #include <kern/limits.h>
+#include <kern/types.h>	/* for __SSIZE_MAX */
 
 /* Provide the real names */
 #define NAME_MAX        __NAME_MAX
@@ -49,5 +50,6 @@
 #define LOGIN_NAME_MAX  __LOGIN_NAME_MAX
 #define OPEN_MAX        __OPEN_MAX
 #define IOV_MAX         __IOV_MAX
+#define SSIZE_MAX       __SSIZE_MAX
 
 #endif /* _LIMITS_H_ */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * When the kernel is built with "options lockstat", spinlocks, locks,
+ * semaphores and CVs record, per lock, how often they were acquired,
+ * how often the acquirer had to wait, how long it waited in total,
+ * and (for spinlocks and locks) the longest time the lock was held.
+ * Sleeping primitives are identified by name, so all locks created
+ * with the same name are counted together; spinlocks have no name
+ * and are identified by the address they were acquired from.
+ *
+ * Statistics are kept per cpu, without locking, and merged when
+ * printed. Times are in nanoseconds, measured with timer_now(); the
+ * on-chip cycle counter is restarted by the timer code and is not
+ * comparable across cpus, so it can't be used here.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+/* Kinds of lock */
+#define LOCKSTAT_SPINLOCK	0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_SEM		2
+#define LOCKSTAT_CV		3
+
+struct lockstat_table;	/* Opaque; one per cpu */
+
+/* Allocate a cpu's (empty) table. Called from cpu_create. */
+struct lockstat_table *lockstat_table_create(void);
+
+/*
+ * Current time for lockstat purposes, or 0 if we aren't collecting.
+ */
+uint64_t lockstat_now(void);
+
+/*
+ * Record an acquisition of the lock of kind KIND identified by NAME
+ * (or, for spinlocks, by the acquire address PC). If the acquirer had
+ * to wait, WAITSTART is when it began; otherwise it is 0. Returns the
+ * time of acquisition (0 if not collecting), to be passed back to
+ * lockstat_released.
+ */
+uint64_t lockstat_acquired(unsigned kind, const char *name, const void *pc,
+			   uint64_t waitstart);
+
+/*
+ * Record a release of a lock acquired at time ACQUIRED.
+ */
+void lockstat_released(unsigned kind, const char *name, const void *pc,
+		       uint64_t acquired);
+
+/* Print the merged statistics; lockstat_reset clears them. */
+void lockstat_dump(void);
+void lockstat_reset(void);
+
+/* Start collecting. Must be called after the clock is attached. */
+void lockstat_bootstrap(void);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _NAMECACHE_H_
+#define _NAMECACHE_H_
+
+/*
+ * Directory name lookup cache.
+ *
+ * A kernel-wide cache mapping (directory vnode, name) to the number
+ * the filesystem uses for the file of that name (for SFS, the inode
+ * number), or recording that the name does not exist (a negative
+ * entry). It stores numbers rather than vnodes so it holds no
+ * references: files can be reclaimed while their names stay cached.
+ *
+ * Filesystems check the cache before searching a directory and fill
+ * it in afterwards. They must also keep it up to date whenever they
+ * add or remove a name (link, remove, rename), holding whatever lock
+ * covers the directory, so it never disagrees with the directory
+ * itself. Entries for a directory are dropped when its vnode is
+ * cleaned up (see vnode_cleanup), so a recycled vnode never inherits
+ * stale names.
+ *
+ * Names of NC_NAMELEN or more characters are not cached. When the
+ * cache is full, the least recently used entry is replaced.
+ */
+
+struct vnode;
+
+#define NC_NAMELEN	32	/* max cached name length, plus one */
+
+/* Results of namecache_lookup */
+#define NC_MISS		0	/* not cached; search the directory */
+#define NC_FOUND	1	/* name exists; number handed back */
+#define NC_NOTFOUND	2	/* name known not to exist */
+
+void namecache_bootstrap(void);
+
+int namecache_lookup(struct vnode *dir, const char *name, uint32_t *ino);
+void namecache_enter(struct vnode *dir, const char *name, uint32_t ino);
+void namecache_enter_negative(struct vnode *dir, const char *name);
+void namecache_remove(struct vnode *dir, const char *name);
+void namecache_purge(struct vnode *dir);
+
+
+#endif /* _NAMECACHE_H_ */
@@ -55,14 +55,16 @@ struct openfile {
 	struct lock *of_offsetlock;	/* lock for of_offset */
 	off_t of_offset;
 
-	struct spinlock of_reflock;	/* lock for of_refcount */
-	int of_refcount;
+	volatile int of_refcount;	/* updated with <atomic.h> */
 };
 
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* wrap an open vnode (consumes the vnode reference on success) */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
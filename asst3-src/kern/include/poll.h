@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll() and select().
+ *
+ * An object that can be waited on (a pipe, the console, a semaphore)
+ * embeds a struct pollq, and its VOP_POLL (see <vnode.h>) works like
+ * this: if given a pollset, first register it on the pollq with
+ * pollset_register; then check and return which of the requested
+ * events are ready now. Whenever something that could make an event
+ * ready happens (data arrives, space frees up, the other end goes
+ * away), the object calls pollq_wakeup. Registering before checking
+ * means a wakeup between the check and the poller going to sleep is
+ * not lost: it marks the pollset, and pollset_wait then returns at
+ * once.
+ *
+ * A pollset is one poll() or select() call. It has room for a fixed
+ * number of registrations, made when it is created; each VOP_POLL
+ * registers at most once. The pollset stays on the pollqs until it
+ * is destroyed, so the caller must hold references that keep the
+ * objects alive until then.
+ *
+ * pollq_wakeup may be called from an interrupt handler. The pollq
+ * lock is taken before the pollset lock, and both are spinlocks, so
+ * it can also be called with the object's own spinlock held.
+ */
+
+#include <spinlock.h>
+#include <kern/poll.h>
+
+struct pollset;		/* Opaque */
+struct pollent;		/* Opaque */
+
+struct pollq {
+	struct spinlock pq_lock;
+	struct pollent *pq_ents;	/* registered pollsets */
+};
+
+/* Events that are always ready for objects that don't support polling. */
+#define POLL_ALWAYS	(POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM)
+
+void pollq_init(struct pollq *pq);
+void pollq_cleanup(struct pollq *pq);
+void pollq_wakeup(struct pollq *pq);
+
+struct pollset *pollset_create(unsigned maxents);
+void pollset_destroy(struct pollset *ps);
+void pollset_register(struct pollset *ps, struct pollq *pq);
+
+/*
+ * Wait until one of the pollqs the pollset is registered on is woken,
+ * or for at most NSECS nanoseconds; NSECS of 0 means no time limit.
+ * Returns false if the time ran out. Wakeups that came in since the
+ * last call (or since creation) count, so this may return at once.
+ */
+bool pollset_wait(struct pollset *ps, uint64_t nsecs);
+
+
+#endif /* _POLL_H_ */
@@ -41,20 +41,46 @@
 
 struct addrspace;
 struct vnode;
+struct cv;
+
+/* Maximum number of user-level threads in a process, counting the first. */
+#define PROC_MAXTHREADS 32
+
+/* States of a user-level thread slot. */
+#define UT_FREE		0	/* not in use */
+#define UT_RUNNING	1	/* thread is alive */
+#define UT_EXITED	2	/* thread has exited but not been joined */
+
+/*
+ * User-level thread slot. The thread id (t_tid) is the slot number;
+ * it also picks the thread's user stack region (see
+ * as_define_threadstack).
+ */
+struct uthread {
+	int ut_state;			/* UT_FREE, UT_RUNNING, or UT_EXITED */
+	int ut_status;			/* Exit status, once exited */
+};
 
 /*
  * Process structure.
  *
- * Note that unless you implement multithreaded processes, p_threads
- * will only contain one thread for all processes other than kproc.
+ * User processes may have several threads (see sys___threadfork).
+ * They all share the address space and file table. A thread that
+ * calls _exit only takes itself out; the process exits when its last
+ * thread leaves, with the status from the first _exit call if there
+ * was one.
  *
  * Note: you can't protect p_threads with a spinlock because it needs
  * to be able to call kmalloc.
  */
 struct proc {
 	char *p_name;			/* Name of this process */
-	struct lock *p_threadslock;	/* Lock for p_threads */
+	struct lock *p_threadslock;	/* Lock for p_threads and p_uthreads */
 	struct threadarray p_threads;	/* Threads in this process */
+	struct cv *p_threadscv;		/* Signaled when a thread exits */
+	struct uthread p_uthreads[PROC_MAXTHREADS]; /* User thread slots */
+	bool p_exiting;			/* True once _exit has been called */
+	int p_exitstatus;		/* Exit status, if p_exiting */
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
 
@@ -93,7 +119,16 @@ void proc_destroy(struct proc *proc);
  * The status code should be prepared with one of the _MKWAIT macros
  * defined in <kern/wait.h>.
  */
-void proc_exit(int status);
+__DEAD void proc_exit(int status);
+
+/*
+ * Cause the current thread to exit with status STATUS, as collected
+ * by threadjoin. If it is the last thread, the process exits too.
+ */
+__DEAD void proc_thread_exit(int status);
+
+/* Reset the user thread slots of the current process after execv. */
+void proc_resetthreads(void);
 
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
@@ -101,6 +136,9 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Return the number of threads in a process. */
+unsigned proc_numthreads(struct proc *proc);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling kernel profiler.
+ *
+ * When the kernel is built with "options prof", hardclock() on each
+ * cpu records where that cpu was when the clock interrupt came in:
+ * in user mode, idle, or in the kernel, in which case the interrupted
+ * PC is counted in a per-cpu table keyed by address. The trap code
+ * saves the PC in the cpu structure (c_intrpc, c_intruser) for this.
+ *
+ * Tables are per cpu and updated with interrupts off, without
+ * locking, and merged when printed. Kernel samples are printed as
+ * "0xADDRESS COUNT" lines, most frequent first, which can be
+ * symbolized on the host with e.g.
+ *    awk '/^0x/ { print $1 }' | addr2line -f -e kernel
+ * or with "info symbol" in gdb.
+ *
+ * Starting and stopping the profiler also turns trace161's own
+ * profiling on and off (via ltrace_setprof), if it is collecting a
+ * profile, so the two cover the same interval.
+ */
+
+#include "opt-prof.h"
+
+#if OPT_PROF
+
+struct prof_table;	/* Opaque; one per cpu */
+
+/* Allocate a cpu's (empty) table. Called from cpu_create. */
+struct prof_table *prof_table_create(void);
+
+/* Take a sample on the current cpu. Called from hardclock. */
+void prof_sample(void);
+
+/* Start or stop sampling. */
+void prof_start(void);
+void prof_stop(void);
+
+/* Print the merged profile, or discard it. */
+void prof_dump(void);
+void prof_reset(void);
+
+#endif /* OPT_PROF */
+
+
+#endif /* _PROF_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SCHEDSTAT_H_
+#define _SCHEDSTAT_H_
+
+/*
+ * Scheduler statistics.
+ *
+ * When the kernel is built with "options schedstat", each cpu keeps
+ *    - a log2 histogram of how long threads waited on its run queue,
+ *      from thread_make_runnable to being switched in;
+ *    - a log2 histogram of its run queue length, sampled at every
+ *      hardclock;
+ *    - counts of voluntary context switches (sleeping, exiting or
+ *      yielding) and involuntary ones (preemption from hardclock);
+ *    - counts of threads thread_consider_migration moved to and
+ *      from it.
+ *
+ * The histograms and switch counts are protected by the cpu's run
+ * queue lock, which is already held wherever they are updated; the
+ * migration counts are updated with atomic_add. The "schedstat" menu
+ * command prints everything, merged across cpus where it makes sense.
+ * Times are measured with timer_now(), as for lockstat.
+ *
+ * Histogram bucket 0 counts zeros; bucket N counts values in
+ * [2^(N-1), 2^N); the last bucket also counts everything larger.
+ */
+
+#include "opt-schedstat.h"
+
+#if OPT_SCHEDSTAT
+
+#define SCHEDSTAT_BUCKETS	32
+
+struct schedstat {
+	unsigned ss_latency[SCHEDSTAT_BUCKETS];	/* run queue wait, ns */
+	unsigned ss_rqlen[SCHEDSTAT_BUCKETS];	/* run queue length */
+	unsigned ss_voluntary;			/* switches, voluntary */
+	unsigned ss_involuntary;		/* switches, preempted */
+	unsigned ss_migrated_in;		/* threads migrated here */
+	unsigned ss_migrated_out;		/* threads migrated away */
+};
+
+struct thread;
+struct cpu;
+
+/* Hooks for the thread code; see thread.c and clock.c. */
+void schedstat_enqueue(struct thread *t);
+void schedstat_switch(struct thread *cur, struct thread *next,
+		      bool preempted);
+void schedstat_migrate(struct cpu *from, struct cpu *to);
+void schedstat_hardclock(void);
+
+/* Print the statistics, or clear them. */
+void schedstat_dump(void);
+void schedstat_reset(void);
+
+/* Start collecting. Must be called after the clock is attached. */
+void schedstat_bootstrap(void);
+
+#endif /* OPT_SCHEDSTAT */
+
+
+#endif /* _SCHEDSTAT_H_ */
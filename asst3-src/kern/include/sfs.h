@@ -56,6 +56,9 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	uint32_t sv_ranext;		/* next block if reads are sequential */
+	uint32_t sv_rahigh;		/* end of blocks already read ahead */
+	unsigned sv_rawindow;		/* current read-ahead size, in blocks */
 };
 
 /*
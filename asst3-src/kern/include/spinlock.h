@@ -36,6 +36,8 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
+#include "opt-ticketlock.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -45,6 +47,33 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+/*
+ * Kinds of spinlock.
+ *
+ * A SPINLOCK_TAS lock is test-and-test-and-set on splk_lock: cheap
+ * when uncontended, but unfair, and every waiter's test-and-set
+ * pulls the lock word away from every other waiter.
+ *
+ * A SPINLOCK_TICKET lock hands out tickets from splk_next and serves
+ * them in order; splk_lock holds the ticket now being served. Each
+ * waiter takes one ticket with an atomic add and then only reads, so
+ * waiters are served first-come first-served and the lock word is
+ * written once per handoff.
+ *
+ * Locks made with spinlock_init or SPINLOCK_INITIALIZER get
+ * SPINLOCK_DEFAULT, which is TICKET if the kernel is configured with
+ * "options ticketlock" and TAS otherwise. Use spinlock_init_kind or
+ * SPINLOCK_TICKET_INITIALIZER to pick ticket for a particular lock.
+ */
+#define SPINLOCK_TAS		0
+#define SPINLOCK_TICKET		1
+
+#if OPT_TICKETLOCK
+#define SPINLOCK_DEFAULT	SPINLOCK_TICKET
+#else
+#define SPINLOCK_DEFAULT	SPINLOCK_TAS
+#endif
+
 /*
  * Basic spinlock.
  *
@@ -56,18 +85,35 @@
  */
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+	volatile spinlock_data_t splk_next; /* Next ticket, if TICKET. */
+	unsigned splk_kind;		    /* SPINLOCK_TAS or _TICKET. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	const void *splk_statpc;	    /* Where it was acquired. */
+	uint64_t splk_acquired;		    /* When it was acquired. */
+#endif
 };
 
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_STAT_INITIALIZER	, NULL, 0
+#else
+#define SPINLOCK_STAT_INITIALIZER
+#endif
+#define SPINLOCK_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, \
+	  SPINLOCK_DEFAULT, NULL SPINLOCK_STAT_INITIALIZER }
+#define SPINLOCK_TICKET_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, \
+	  SPINLOCK_TICKET, NULL SPINLOCK_STAT_INITIALIZER }
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_kind	Same, but with a specific kind (SPINLOCK_TAS or _TICKET).
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
@@ -77,6 +123,7 @@ struct spinlock {
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_kind(struct spinlock *lk, unsigned kind);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -77,6 +77,9 @@ struct lock {
 	struct wchan *lk_wchan;
 	struct spinlock lk_lock;
 	struct thread *volatile lk_holder;
+#if OPT_LOCKSTAT
+	uint64_t lk_acquired;		/* when lk_holder got it */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -127,6 +130,10 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_wait_timeout - Like cv_wait, but give up after NSECS
+ *                   nanoseconds. Returns 0 if woken and ETIMEDOUT if
+ *                   the time ran out; either way the lock is held
+ *                   again on return.
  *
  * For all three operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
@@ -135,8 +142,64 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_timeout(struct cv *cv, struct lock *lock, uint64_t nsecs);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers, or one writer, may hold the lock at once.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * behind it, so a steady stream of readers can't starve writers.
+ * Read holds are not recursive (a thread that already holds the lock
+ * for reading and asks again can deadlock behind a waiting writer).
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+	char *rw_name;
+	struct wchan *rw_readwchan;	/* readers wait here */
+	struct wchan *rw_writewchan;	/* writers and upgraders wait here */
+	struct spinlock rw_lock;
+	unsigned rw_readers;		/* number of read holds */
+	unsigned rw_writewaiters;	/* number of writers waiting */
+	struct thread *rw_writer;	/* thread holding for write, or NULL */
+	struct thread *rw_upgrader;	/* reader waiting to upgrade, or NULL */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock shared.
+ *    rwlock_release_read  - Release a shared hold.
+ *    rwlock_acquire_write - Get the lock exclusive.
+ *    rwlock_release_write - Release an exclusive hold.
+ *    rwlock_upgrade       - Turn our shared hold into an exclusive
+ *                           one, waiting for the other readers to
+ *                           leave. Only one reader can be upgrading
+ *                           at a time; if another one already is,
+ *                           fails and returns false, and the caller
+ *                           still holds the lock shared (and should
+ *                           drop it and acquire for write instead,
+ *                           rechecking whatever it looked at).
+ *    rwlock_downgrade     - Turn our exclusive hold into a shared one
+ *                           without letting any writer in between.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock exclusive. (There is no way to
+ *                           check for shared holds.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_upgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
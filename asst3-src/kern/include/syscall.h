@@ -47,6 +47,10 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+/* Helper for __threadfork(). Enter user mode at ENTRYPOINT(ARG). */
+__DEAD void enter_new_thread(struct trapframe *tf, userptr_t arg,
+			     vaddr_t stackptr, vaddr_t entrypoint);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
@@ -54,6 +58,9 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,19 +71,39 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys___threadfork(struct trapframe *tf, userptr_t entry, userptr_t arg,
+		     int *retval);
+__DEAD void sys_threadexit(int status);
+int sys_threadjoin(int tid, userptr_t status);
+int sys_futex_wait(userptr_t addr, int val, const_userptr_t timeout);
+int sys_futex_wake(userptr_t addr, int count, int *retval);
+int sys_setaffinity(unsigned mask);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, const_userptr_t timeout, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
@@ -57,6 +57,9 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int rwtest(int, char **);
+int timertest(int, char **);
+int spinlockbench(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
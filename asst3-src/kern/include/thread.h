@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include "opt-schedstat.h"
 
 struct cpu;
 
@@ -82,7 +83,11 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	unsigned t_affinity;		/* CPUs it may run on; see below */
 	struct proc *t_proc;		/* Process thread belongs to */
+#if OPT_SCHEDSTAT
+	uint64_t t_readysince;		/* When put on the run queue */
+#endif
 
 	/*
 	 * Interrupt state fields.
@@ -105,6 +110,8 @@ struct thread {
 	 * Public fields
 	 */
 
+	unsigned t_tid;			/* User-level thread id in t_proc */
+
 	/* add more here as needed */
 };
 
@@ -168,5 +175,30 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * CPU affinity.
+ *
+ * A thread's affinity mask has bit N set if it may run on the cpu
+ * whose c_number is N. New threads inherit the mask of the thread
+ * that forked them. thread_make_runnable and thread_consider_migration
+ * only ever put a thread on a run queue its mask allows; a thread
+ * that is running or already queued when its mask changes moves at
+ * its next context switch.
+ *
+ * thread_setaffinity sets T's mask to MASK, ignoring cpus that don't
+ * exist, and fails with EINVAL if that leaves none. If T is the
+ * current thread and may no longer run here, it moves before
+ * returning.
+ *
+ * thread_pin confines the current thread to cpu CPUNUM, e.g. for a
+ * kernel worker thread that should stay put.
+ */
+#define CPUMASK_BITS	32
+#define CPUMASK_ALL	0xffffffffU
+#define CPUMASK_CPU(n)	(1U << (n))
+
+int thread_setaffinity(struct thread *t, unsigned mask);
+int thread_pin(unsigned cpunum);
+
 
 #endif /* _THREAD_H_ */
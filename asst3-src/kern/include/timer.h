@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * High-resolution kernel timers.
+ *
+ * A struct timer is a one-shot callout: once started, its function is
+ * called (once) from the timer interrupt on the cpu that started it,
+ * at or shortly after the requested deadline. Each cpu keeps its
+ * pending timers in a heap ordered by deadline and programs its
+ * on-chip timer for whichever comes first, the next timer or the next
+ * hardclock, so resolution is not limited by HZ.
+ *
+ * Times are in nanoseconds; timer_now() returns the current time in
+ * those units.
+ *
+ * The timer structure belongs to the caller (it is typically embedded
+ * in something else or on the stack) and must not be freed or reused
+ * while it is pending or its function is running; timer_cancel()
+ * guarantees both are over when it returns.
+ *
+ * Timer functions run in interrupt context with interrupts off and
+ * may not sleep. They may start (other) timers. They must not call
+ * timer_cancel on themselves.
+ */
+
+struct cpu;	/* from <cpu.h> */
+struct spinlock;	/* from <spinlock.h> */
+struct wchan;	/* from <wchan.h> */
+
+typedef void (*timer_func)(void *data);
+
+struct timer {
+	uint64_t tm_deadline;		/* when to fire, per timer_now() */
+	timer_func tm_func;		/* function to call */
+	void *tm_data;			/* argument for tm_func */
+	struct cpu *tm_cpu;		/* cpu that owns us, or NULL if idle */
+	bool tm_queued;			/* true if on tm_cpu's heap */
+
+	/* pairing heap linkage; protected by tm_cpu's c_timers_lock */
+	struct timer *tm_child;		/* leftmost child */
+	struct timer *tm_sibling;	/* next sibling to the right */
+	struct timer *tm_prev;		/* left sibling, or parent */
+};
+
+/* nanoseconds per second */
+#define NSECS_PER_SEC	1000000000ULL
+
+/* Current time, in nanoseconds. */
+uint64_t timer_now(void);
+
+/* Set up a timer. It is not started. */
+void timer_init(struct timer *t, timer_func func, void *data);
+
+/*
+ * Start a timer to fire NSECS nanoseconds from now, or at the
+ * absolute time DEADLINE. The timer must not be pending (cancel it
+ * first), except that a timer function may restart its own timer.
+ */
+void timer_start(struct timer *t, uint64_t nsecs);
+void timer_start_abs(struct timer *t, uint64_t deadline);
+
+/*
+ * Stop a timer. Returns true if it was pending and has been removed
+ * before firing; false if it was not started or has already fired.
+ * If the timer function is running on another cpu, waits for it to
+ * finish.
+ */
+bool timer_cancel(struct timer *t);
+
+/*
+ * Sleep on wait channel WC (whose spinlock LK must be held, as with
+ * wchan_sleep) for at most NSECS nanoseconds. Returns true if woken
+ * by someone else and false if the time ran out.
+ */
+bool timer_wchan_sleep(struct wchan *wc, struct spinlock *lk,
+		       uint64_t nsecs);
+
+/*
+ * Suspend execution for NSECS nanoseconds. Like clocksleep() but with
+ * better resolution.
+ */
+void timer_sleep(uint64_t nsecs);
+
+/*
+ * Called from the platform's timer interrupt on each cpu. Fires any
+ * expired timers and returns true if hardclock() is due; in *NSECS
+ * returns how long from now the platform should schedule the next
+ * timer interrupt.
+ */
+bool timer_interrupt(uint32_t *nsecs);
+
+/* Setup. */
+void timer_bootstrap(void);
+
+
+#endif /* _TIMER_H_ */
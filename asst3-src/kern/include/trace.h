@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel tracepoints.
+ *
+ * When the kernel is built with "options trace", the TRACE() calls
+ * scattered through the kernel append a timestamped fixed-size record
+ * to a ring buffer belonging to the current cpu. Nothing is printed
+ * at the time; the "trace" menu command later merges the rings in
+ * time order and prints them. Without the option TRACE() compiles to
+ * nothing.
+ *
+ * Recording takes no locks: the writer claims a slot in its own
+ * cpu's ring with atomic_add, so tracepoints may be used in interrupt
+ * handlers and with spinlocks held. When a ring fills up the oldest
+ * records are overwritten. Timestamps come from timer_now(), as for
+ * lockstat, so records from different cpus can be compared.
+ *
+ * Tracing starts out off and is switched on and off from the menu.
+ */
+
+#include "opt-trace.h"
+
+/*
+ * Events. Each record carries two event-specific words, A and B.
+ * To add an event, add it here and to the name table in trace.c.
+ */
+#define TRACE_SWITCH		0	/* thread switch: old, new thread */
+#define TRACE_VMFAULT		1	/* vm_fault: fault type, address */
+#define TRACE_SYSCALL		2	/* syscall entry: call number, - */
+#define TRACE_SYSRET		3	/* syscall exit: call number, error */
+#define TRACE_DISKSTART		4	/* lhd request: sector, is write */
+#define TRACE_DISKDONE		5	/* lhd completion: sector, error */
+#define TRACE_SLEEP		6	/* wchan_sleep: wchan, thread */
+#define TRACE_WAKE		7	/* wchan wakeup: wchan, thread */
+#define NTRACEEVENTS		8
+
+#if OPT_TRACE
+
+struct trace_ring;	/* Opaque; one per cpu */
+
+/* Allocate a cpu's (empty) ring. Called from cpu_create. */
+struct trace_ring *trace_ring_create(void);
+
+/* Record event EV with arguments A and B. Use TRACE() instead. */
+void trace_record(unsigned ev, uint32_t a, uint32_t b);
+
+#define TRACE(ev, a, b) trace_record(ev, (uint32_t)(a), (uint32_t)(b))
+
+/* Turn recording on or off. */
+void trace_enable(bool on);
+
+/* Print all buffered records in time order, and discard them. */
+void trace_drain(void);
+
+/* Discard all buffered records. */
+void trace_clear(void);
+
+#else
+
+#define TRACE(ev, a, b) ((void)0)
+
+#endif /* OPT_TRACE */
+
+
+#endif /* _TRACE_H_ */
@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollset;
 
 
 /*
@@ -49,8 +50,7 @@ struct stat;
  * Note: vn_fs may be null if the vnode refers to a device.
  */
 struct vnode {
-	int vn_refcount;                /* Reference count */
-	struct spinlock vn_countlock;   /* Lock for vn_refcount */
+	volatile int vn_refcount;       /* Reference count (see <atomic.h>) */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -132,6 +132,14 @@ struct vnode {
  *                      uio. Need not work on objects that are not
  *                      directories.
  *
+ *    vop_poll        - Return which of the poll events EVENTS (see
+ *                      kern/poll.h) are ready now, plus any of
+ *                      POLLERR and POLLHUP that apply. If PS is not
+ *                      NULL, first register it (once) on the object's
+ *                      pollq so it is woken when that may change; see
+ *                      poll.h. Optional; if NULL, the object is
+ *                      always ready for reading and writing.
+ *
  *****************************************
  *
  *    vop_creat       - Create a regular file named NAME in the passed
@@ -196,6 +204,8 @@ struct vnode_ops {
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct pollset *ps);
 
 
 	int (*vop_creat)(struct vnode *dir,
@@ -240,6 +250,7 @@ struct vnode_ops {
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
+#define VOP_POLL(vn, events, ps)        (vnode_poll(vn, events, ps))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
 #define VOP_SYMLINK(vn, name, content)  (__VOP(vn, symlink)(vn, name, content))
@@ -257,11 +268,17 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Poll, supplying the default for objects without vop_poll
+ */
+int vnode_poll(struct vnode *, int events, struct pollset *ps);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
 void vnode_incref(struct vnode *);
 void vnode_decref(struct vnode *);
+bool vnode_reclaimable(struct vnode *);	/* for use by VOP_RECLAIM */
 
 #define VOP_INCREF(vn) 			vnode_incref(vn)
 #define VOP_DECREF(vn) 			vnode_decref(vn)
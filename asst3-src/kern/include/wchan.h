@@ -37,6 +37,7 @@
 
 struct spinlock; /* in spinlock.h */
 struct wchan; /* Opaque */
+struct thread; /* in thread.h */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -76,5 +77,13 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Wake up thread T if (and only if) it is sleeping on the wait
+ * channel; return true if it was. The associated spinlock should be
+ * locked. Used for timeouts.
+ */
+bool wchan_wakethread(struct wchan *wc, struct spinlock *lk,
+		      struct thread *t);
+
 
 #endif /* _WCHAN_H_ */
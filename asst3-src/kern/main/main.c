@@ -38,6 +38,9 @@
 #include <lib.h>
 #include <spl.h>
 #include <clock.h>
+#include <timer.h>
+#include <lockstat.h>
+#include <schedstat.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -127,9 +130,17 @@ boot(void)
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
+	timer_bootstrap();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
+#if OPT_SCHEDSTAT
+	schedstat_bootstrap();
+#endif
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
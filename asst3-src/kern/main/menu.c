@@ -37,6 +37,11 @@
 #include <uio.h>
 #include <clock.h>
 #include <thread.h>
+#include <lockstat.h>
+#include <cpustat.h>
+#include <trace.h>
+#include <prof.h>
+#include <schedstat.h>
 #include <proc.h>
 #include <vfs.h>
 #include <sfs.h>
@@ -408,6 +413,111 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_cpustat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		cpustat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		cpustat_reset();
+	}
+	else {
+		kprintf("Usage: cpustat [reset]\n");
+	}
+
+	return 0;
+}
+
+#if OPT_TRACE
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	if (nargs == 1) {
+		trace_drain();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		trace_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		trace_enable(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		trace_clear();
+	}
+	else {
+		kprintf("Usage: trace [on|off|clear]\n");
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_PROF
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	if (nargs == 1) {
+		prof_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		prof_start();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		prof_reset();
+	}
+	else {
+		kprintf("Usage: prof [on|off|reset]\n");
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_SCHEDSTAT
+static
+int
+cmd_schedstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		schedstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		schedstat_reset();
+	}
+	else {
+		kprintf("Usage: schedstat [reset]\n");
+	}
+
+	return 0;
+}
+#endif
+
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else {
+		kprintf("Usage: lockstat [reset]\n");
+	}
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -482,6 +592,9 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] RW lock test                  ",
+	"[tmt] Timer test                    ",
+	"[slb] Spinlock benchmark            ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -512,6 +625,19 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[cpustat] Per-cpu counters [reset]  ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock statistics [reset]  ",
+#endif
+#if OPT_TRACE
+	"[trace] Trace [on|off|clear]        ",
+#endif
+#if OPT_PROF
+	"[prof] Profile [on|off|reset]       ",
+#endif
+#if OPT_SCHEDSTAT
+	"[schedstat] Scheduler stats [reset] ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -561,6 +687,19 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "cpustat",    cmd_cpustat },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
+#if OPT_TRACE
+	{ "trace",      cmd_trace },
+#endif
+#if OPT_PROF
+	{ "prof",       cmd_prof },
+#endif
+#if OPT_SCHEDSTAT
+	{ "schedstat",  cmd_schedstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -583,6 +722,9 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	rwtest },
+	{ "tmt",	timertest },
+	{ "slb",	spinlockbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
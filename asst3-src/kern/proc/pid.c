@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+
 /*
  * Process ID management.
  */
@@ -36,7 +37,7 @@
 #include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
-#include <array.h>
+#include <spinlock.h>
 #include <clock.h>
 #include <thread.h>
 #include <proc.h>
@@ -47,60 +48,104 @@
 /*
  * Structure for holding exit data of a thread.
  *
- * If pi_ppid is INVALID_PID, the parent has gone away and will not be
- * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
- * structure can be freed.
+ * If pi_ppid is INVALID_PID, the parent has gone away or already
+ * collected the exit status, and will not be waiting. If pi_ppid is
+ * INVALID_PID and pi_exited is true, the structure can be freed, once
+ * any threads still waiting in pid_wait (pi_waiters) have let go.
+ *
+ * Each pidinfo is on the child list (pi_kids) of its parent's
+ * pidinfo for exactly as long as pi_ppid names the parent, so a
+ * process only ever has to look at its own children, never at the
+ * whole table.
+ *
+ * pi_pid is constant once the pidinfo is in the table, and
+ * pi_hashnext belongs to the table. pi_kids and the sibling links of
+ * the children on it are protected by the parent's pi_lock; the other
+ * fields by the pidinfo's own pi_lock, which is also the lock for
+ * pi_cv. A parent's pi_lock comes before its children's.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
+	unsigned pi_waiters;		// threads sleeping in pid_wait
+	struct lock *pi_lock;		// lock for the above
 	struct cv *pi_cv;		// use to wait for thread exit
+	struct pidinfo *pi_kids;	// our children
+	struct pidinfo *pi_nextsib;	// next child of our parent
+	struct pidinfo **pi_prevsib;	// pointer to us in that list
+	struct pidinfo *pi_hashnext;	// next in hash chain
 };
 
-
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is a hash table with chaining, with one bucket
+ * per allowed process so that chains stay short; consecutive pids
+ * land in consecutive buckets. Each bucket has its own spinlock,
+ * which only covers walking and changing the chain, so lookups of
+ * different pids don't contend.
+ *
+ * nextpid and nprocs are protected by pidalloc_lock, which comes
+ * before the bucket locks. A pid is skipped by pid_alloc only if that
+ * very pid is still in use.
+ *
+ * A pidinfo is only freed (by pi_drop) when both the process and its
+ * parent are done with it, so the current process's own pidinfo, and
+ * those of its children, stay valid without holding any table lock.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
+#define PID_HASHSIZE	PROCS_MAX
+#define PID_HASH(pid)	((unsigned)(pid) % PID_HASHSIZE)
+
+struct pidbucket {
+	struct spinlock pb_lock;	// lock for the chain
+	struct pidinfo *pb_head;	// chain of pidinfos
+};
+
+static struct pidbucket pidtable[PID_HASHSIZE]; // actual pid info
+static struct spinlock pidalloc_lock;	// lock for the following
 static pid_t nextpid;			// next candidate pid
 static int nprocs;			// number of allocated pids
 
 
 
 /*
- * Create a pidinfo structure for the specified pid.
+ * Create a pidinfo structure, with no pid yet.
  */
 static
 struct pidinfo *
-pidinfo_create(pid_t pid, pid_t ppid)
+pidinfo_create(pid_t ppid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid != INVALID_PID);
-
 	pi = kmalloc(sizeof(struct pidinfo));
 	if (pi==NULL) {
 		return NULL;
 	}
 
+	pi->pi_lock = lock_create("pidinfo lock");
+	if (pi->pi_lock == NULL) {
+		kfree(pi);
+		return NULL;
+	}
+
 	pi->pi_cv = cv_create("pidinfo cv");
 	if (pi->pi_cv == NULL) {
+		lock_destroy(pi->pi_lock);
 		kfree(pi);
 		return NULL;
 	}
 
-	pi->pi_pid = pid;
+	pi->pi_pid = INVALID_PID;
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	pi->pi_waiters = 0;
+	pi->pi_kids = NULL;
+	pi->pi_nextsib = NULL;
+	pi->pi_prevsib = NULL;
+	pi->pi_hashnext = NULL;
 
 	return pi;
 }
@@ -114,99 +159,187 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
+	KASSERT(pi->pi_waiters == 0);
+	KASSERT(pi->pi_kids == NULL);
+	KASSERT(pi->pi_prevsib == NULL);
 	cv_destroy(pi->pi_cv);
+	lock_destroy(pi->pi_lock);
 	kfree(pi);
 }
 
 ////////////////////////////////////////////////////////////
 
 /*
- * pid_bootstrap: initialize.
- */
-void
-pid_bootstrap(void)
-{
-	int i;
-
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
-	}
-
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
-	}
-
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
-		panic("Out of memory creating kernel pid data\n");
-	}
-
-	nextpid = PID_MIN;
-	nprocs = 1;
-}
-
-/*
- * pi_get: look up a pidinfo in the process table.
+ * pi_get: look up a pidinfo in the process table. The result is only
+ * safe to use if it's the current process's own or one of its
+ * children's (see above).
  */
 static
 struct pidinfo *
 pi_get(pid_t pid)
 {
+	struct pidbucket *pb;
 	struct pidinfo *pi;
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
-		return NULL;
-	}
-	if (pi->pi_pid != pid) {
-		return NULL;
+	pb = &pidtable[PID_HASH(pid)];
+	spinlock_acquire(&pb->pb_lock);
+	for (pi = pb->pb_head; pi != NULL; pi = pi->pi_hashnext) {
+		if (pi->pi_pid == pid) {
+			break;
+		}
 	}
+	spinlock_release(&pb->pb_lock);
 	return pi;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_put: insert a new pidinfo in the process table under pid PID,
+ * which must not be in use.
  */
 static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidbucket *pb;
 
 	KASSERT(pid != INVALID_PID);
+	KASSERT(pi->pi_pid == INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	pi->pi_pid = pid;
+	pb = &pidtable[PID_HASH(pid)];
+	spinlock_acquire(&pb->pb_lock);
+	pi->pi_hashnext = pb->pb_head;
+	pb->pb_head = pi;
+	spinlock_release(&pb->pb_lock);
 }
 
 /*
  * pi_drop: remove a pidinfo structure from the process table and free
  * it. It should reflect a process that has already exited and been
- * waited for.
+ * waited for (or disowned).
  */
 static
 void
-pi_drop(pid_t pid)
+pi_drop(struct pidinfo *pi)
 {
-	struct pidinfo *pi;
+	struct pidbucket *pb;
+	struct pidinfo **pp;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	pb = &pidtable[PID_HASH(pi->pi_pid)];
+	spinlock_acquire(&pb->pb_lock);
+	for (pp = &pb->pb_head; *pp != pi; pp = &(*pp)->pi_hashnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = pi->pi_hashnext;
+	spinlock_release(&pb->pb_lock);
 
-	pi = pidinfo[pid % PROCS_MAX];
-	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	spinlock_acquire(&pidalloc_lock);
+	nprocs--;
+	spinlock_release(&pidalloc_lock);
 
 	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+}
+
+/*
+ * pi_addkid: put KID on PARENT's child list. PARENT's pi_lock must be
+ * held.
+ */
+static
+void
+pi_addkid(struct pidinfo *parent, struct pidinfo *kid)
+{
+	KASSERT(lock_do_i_hold(parent->pi_lock));
+	KASSERT(kid->pi_prevsib == NULL);
+
+	kid->pi_nextsib = parent->pi_kids;
+	if (parent->pi_kids != NULL) {
+		parent->pi_kids->pi_prevsib = &kid->pi_nextsib;
+	}
+	parent->pi_kids = kid;
+	kid->pi_prevsib = &parent->pi_kids;
+}
+
+/*
+ * pi_remkid: take KID off its parent's child list. The parent's
+ * pi_lock must be held.
+ */
+static
+void
+pi_remkid(struct pidinfo *kid)
+{
+	KASSERT(kid->pi_prevsib != NULL);
+
+	*kid->pi_prevsib = kid->pi_nextsib;
+	if (kid->pi_nextsib != NULL) {
+		kid->pi_nextsib->pi_prevsib = kid->pi_prevsib;
+	}
+	kid->pi_nextsib = NULL;
+	kid->pi_prevsib = NULL;
+}
+
+/*
+ * pi_findkid: find the child of US with pid PID, or NULL. US's
+ * pi_lock must be held.
+ */
+static
+struct pidinfo *
+pi_findkid(struct pidinfo *us, pid_t pid)
+{
+	struct pidinfo *kid;
+
+	KASSERT(lock_do_i_hold(us->pi_lock));
+
+	for (kid = us->pi_kids; kid != NULL; kid = kid->pi_nextsib) {
+		if (kid->pi_pid == pid) {
+			return kid;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Get the current process's own pidinfo.
+ */
+static
+struct pidinfo *
+pi_self(void)
+{
+	struct pidinfo *us;
+
+	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	return us;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * pid_bootstrap: initialize.
+ */
+void
+pid_bootstrap(void)
+{
+	struct pidinfo *pi;
+	int i;
+
+	spinlock_init(&pidalloc_lock);
+	for (i=0; i<PID_HASHSIZE; i++) {
+		spinlock_init(&pidtable[i].pb_lock);
+		pidtable[i].pb_head = NULL;
+	}
+
+	pi = pidinfo_create(INVALID_PID);
+	if (pi==NULL) {
+		panic("Out of memory creating kernel pid data\n");
+	}
+	pi_put(KERNEL_PID, pi);
+
+	nextpid = PID_MIN;
+	nprocs = 1;
 }
 
 ////////////////////////////////////////////////////////////
@@ -218,7 +351,7 @@ static
 void
 inc_nextpid(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(spinlock_do_i_hold(&pidalloc_lock));
 
 	nextpid++;
 	if (nextpid > PID_MAX) {
@@ -232,48 +365,53 @@ inc_nextpid(void)
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
+	struct pidinfo *us, *pi;
 	pid_t pid;
 	int count;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_self();
+
+	/* Allocate first; we can't sleep holding pidalloc_lock. */
+	pi = pidinfo_create(curproc->p_pid);
+	if (pi==NULL) {
+		return ENOMEM;
+	}
 
-	/* lock the table */
-	lock_acquire(pidlock);
+	spinlock_acquire(&pidalloc_lock);
 
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		spinlock_release(&pidalloc_lock);
+		pi->pi_exited = true;
+		pi->pi_ppid = INVALID_PID;
+		pidinfo_destroy(pi);
 		return EAGAIN;
 	}
 
 	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
+	 * Skip pids that are still in use. There are fewer than
+	 * PROCS_MAX of those, so this terminates quickly, unless our
+	 * nprocs count is off. Even so, assert we aren't looping
 	 * forever.
 	 */
 	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
+	while (pi_get(nextpid) != NULL) {
+		KASSERT(count < PROCS_MAX);
 		count++;
 
 		inc_nextpid();
 	}
 
 	pid = nextpid;
-
-	pi = pidinfo_create(pid, curproc->p_pid);
-	if (pi==NULL) {
-		lock_release(pidlock);
-		return ENOMEM;
-	}
-
 	pi_put(pid, pi);
+	nprocs++;
 
 	inc_nextpid();
 
-	lock_release(pidlock);
+	spinlock_release(&pidalloc_lock);
+
+	lock_acquire(us->pi_lock);
+	pi_addkid(us, pi);
+	lock_release(us->pi_lock);
 
 	*retval = pid;
 	return 0;
@@ -286,14 +424,18 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	us = pi_self();
 
-	them = pi_get(theirpid);
+	lock_acquire(us->pi_lock);
+	them = pi_findkid(us, theirpid);
 	KASSERT(them != NULL);
+	pi_remkid(them);
+
+	lock_acquire(them->pi_lock);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
@@ -301,10 +443,34 @@ pid_unalloc(pid_t theirpid)
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
 	them->pi_ppid = INVALID_PID;
+	lock_release(them->pi_lock);
+	lock_release(us->pi_lock);
 
-	pi_drop(theirpid);
+	pi_drop(them);
+}
+
+/*
+ * Disown child THEM, whose parent US's pi_lock we hold. Returns true
+ * if it has already exited, in which case the caller should pi_drop
+ * it (after releasing US's lock).
+ */
+static
+bool
+pi_disown(struct pidinfo *us, struct pidinfo *them)
+{
+	bool exited;
+
+	KASSERT(lock_do_i_hold(us->pi_lock));
+
+	pi_remkid(them);
+
+	lock_acquire(them->pi_lock);
+	KASSERT(them->pi_ppid == us->pi_pid);
+	them->pi_ppid = INVALID_PID;
+	exited = them->pi_exited;
+	lock_release(them->pi_lock);
 
-	lock_release(pidlock);
+	return exited;
 }
 
 /*
@@ -314,22 +480,22 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool exited;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	us = pi_self();
 
-	them = pi_get(theirpid);
+	lock_acquire(us->pi_lock);
+	them = pi_findkid(us, theirpid);
 	KASSERT(them != NULL);
-	KASSERT(them->pi_ppid==curproc->p_pid);
+	exited = pi_disown(us, them);
+	lock_release(us->pi_lock);
 
-	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
+	if (exited) {
+		pi_drop(them);
 	}
-
-	lock_release(pidlock);
 }
 
 /*
@@ -343,42 +509,47 @@ pid_disown(pid_t theirpid)
 void
 pid_setexitstatus(int status)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidinfo *us, *kid, *dead;
+	bool orphan;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_self();
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
+	lock_acquire(us->pi_lock);
+
+	/*
+	 * First, disown all children. The ones that have already
+	 * exited are only ours now; chain them on their (now unused)
+	 * sibling links to drop once we let go of our lock.
+	 */
+	dead = NULL;
+	while ((kid = us->pi_kids) != NULL) {
+		if (pi_disown(us, kid)) {
+			kid->pi_nextsib = dead;
+			dead = kid;
 		}
 	}
 
 	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
-
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
+	orphan = (us->pi_ppid == INVALID_PID);
+	if (!orphan) {
+		cv_broadcast(us->pi_cv, us->pi_lock);
+	}
+	lock_release(us->pi_lock);
 
-	if (us->pi_ppid == INVALID_PID) {
-		/* no parent */
-		pi_drop(curproc->p_pid);
+	while ((kid = dead) != NULL) {
+		dead = kid->pi_nextsib;
+		kid->pi_nextsib = NULL;
+		pi_drop(kid);
 	}
-	else {
-		cv_broadcast(us->pi_cv, pidlock);
+
+	if (orphan) {
+		/* no parent */
+		pi_drop(us);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
 }
 
 /*
@@ -388,11 +559,18 @@ pid_setexitstatus(int status)
  *
  * status may be null, in which case the status is thrown away. ret
  * may only be null if WNOHANG is not set.
+ *
+ * Several threads of the parent may wait for the same child; the
+ * first to get back collects the status and the others fail with
+ * ESRCH. Each holds a count in pi_waiters while it sleeps, and
+ * whoever drops the count to zero after the child is collected frees
+ * it.
  */
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool drop;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
@@ -415,32 +593,55 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
-		return ESRCH;
-	}
+	us = pi_self();
 
-	KASSERT(them->pi_pid==theirpid);
+	lock_acquire(us->pi_lock);
 
 	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
+	them = pi_findkid(us, theirpid);
+	if (them == NULL) {
+		lock_release(us->pi_lock);
+		/* Not ours; someone else's, or nobody's? */
+		return pi_get(theirpid) != NULL ? EPERM : ESRCH;
 	}
 
+	lock_acquire(them->pi_lock);
+
 	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			lock_release(them->pi_lock);
+			lock_release(us->pi_lock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+
+		/*
+		 * Don't hold up our other children while we wait.
+		 * pi_waiters keeps THEM from being freed meanwhile.
+		 */
+		them->pi_waiters++;
+		lock_release(us->pi_lock);
+		while (them->pi_exited == false) {
+			cv_wait(them->pi_cv, them->pi_lock);
+		}
+		lock_release(them->pi_lock);
+
+		/* Retake the locks in order. */
+		lock_acquire(us->pi_lock);
+		lock_acquire(them->pi_lock);
+		them->pi_waiters--;
+
+		if (them->pi_ppid != curproc->p_pid) {
+			/* Another of our threads collected it. */
+			drop = (them->pi_waiters == 0);
+			lock_release(them->pi_lock);
+			lock_release(us->pi_lock);
+			if (drop) {
+				pi_drop(them);
+			}
+			return ESRCH;
+		}
 	}
 
 	if (status != NULL) {
@@ -457,9 +658,15 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		*ret = theirpid;
 	}
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	pi_remkid(them);
+	them->pi_ppid = INVALID_PID;
+	drop = (them->pi_waiters == 0);
+	lock_release(them->pi_lock);
+	lock_release(us->pi_lock);
+
+	if (drop) {
+		pi_drop(them);
+	}
 
-	lock_release(pidlock);
 	return 0;
 }
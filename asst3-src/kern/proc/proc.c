@@ -38,8 +38,9 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes can have more than one thread; the user-level
+ * thread slots (p_uthreads) are protected by p_threadslock along with
+ * p_threads.
  */
 
 #include <types.h>
@@ -52,6 +53,7 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <kern/wait.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -66,6 +68,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	unsigned i;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -85,6 +88,21 @@ proc_create(const char *name)
 	}
 	threadarray_init(&proc->p_threads);
 
+	proc->p_threadscv = cv_create("p_threads");
+	if (proc->p_threadscv == NULL) {
+		lock_destroy(proc->p_threadslock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		proc->p_uthreads[i].ut_state = UT_FREE;
+		proc->p_uthreads[i].ut_status = 0;
+	}
+	proc->p_uthreads[0].ut_state = UT_RUNNING;
+	proc->p_exiting = false;
+	proc->p_exitstatus = 0;
+
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
 
@@ -185,6 +203,7 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
 	threadarray_cleanup(&proc->p_threads);
+	cv_destroy(proc->p_threadscv);
 	lock_destroy(proc->p_threadslock);
 
 	kfree(proc->p_name);
@@ -303,6 +322,15 @@ proc_fork(struct proc **ret)
 		}
 	}
 
+	/*
+	 * User threads: the new process has just the one thread,
+	 * which keeps the caller's thread id because it is running on
+	 * that slot's stack. (The stack regions came along with
+	 * as_copy.)
+	 */
+	newproc->p_uthreads[0].ut_state = UT_FREE;
+	newproc->p_uthreads[curthread->t_tid].ut_state = UT_RUNNING;
+
 	/* VFS fields */
 	tbl = curproc->p_filetable;
 	if (tbl != NULL) {
@@ -345,33 +373,143 @@ proc_unfork(struct proc *newproc)
 }
 
 /*
- * Make the current process exit.
+ * Take thread T out of PROC's p_threads. The caller holds
+ * p_threadslock. Returns the number of threads left.
  */
+static
+unsigned
+proc_dropthread(struct proc *proc, struct thread *t)
+{
+	unsigned num, i;
+
+	KASSERT(lock_do_i_hold(proc->p_threadslock));
+
+	/* ugh: find the thread in the array */
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		if (threadarray_get(&proc->p_threads, i) == t) {
+			threadarray_remove(&proc->p_threads, i);
+			return num - 1;
+		}
+	}
+	/* Did not find it. */
+	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+}
+
+/*
+ * Take the current thread out of process PROC and put it in the
+ * kernel process, then exit it. If it was the last thread, the
+ * process exits with status PROCSTATUS unless an earlier _exit set
+ * one.
+ *
+ * Whether we're last has to be decided under p_threadslock in the
+ * same breath as taking ourselves out of p_threads, or two threads
+ * leaving at once could each think the other one is still around.
+ */
+static
+__DEAD
 void
-proc_exit(int status)
+proc_leave(struct proc *proc, int procstatus)
 {
-	struct proc *proc = curproc;
+	unsigned num;
+	int spl;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
+	KASSERT(curthread->t_proc == proc);
+
+	lock_acquire(proc->p_threadslock);
+	num = proc_dropthread(proc, curthread);
+	if (proc->p_exiting) {
+		procstatus = proc->p_exitstatus;
+	}
+	lock_release(proc->p_threadslock);
 
-	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	if (num == 0) {
+		/* Set exit status and wake up anyone waiting for us. */
+		pid_setexitstatus(procstatus);
+	}
 
 	/* Detach from the process and attach to the kernel process. */
-	KASSERT(curthread->t_proc == proc);
-	proc_remthread(curthread);
+	spl = splhigh();
+	curthread->t_proc = NULL;
+	splx(spl);
 	proc_addthread(kproc, curthread);
 
-	/* There should be no threads left in the target process. */
-	KASSERT(threadarray_num(&proc->p_threads) == 0);
-
-	/* Now we can destroy the process. */
-	proc_destroy(proc);
+	if (num == 0) {
+		/* Now we can destroy the process. */
+		proc_destroy(proc);
+	}
 
 	thread_exit();
 }
 
+/*
+ * Make the current process exit. Other threads in the process, if
+ * any, keep running; the process is gone once they've exited too.
+ */
+void
+proc_exit(int status)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+
+	lock_acquire(proc->p_threadslock);
+	if (!proc->p_exiting) {
+		proc->p_exiting = true;
+		proc->p_exitstatus = status;
+	}
+	/* Nobody can join a thread that went out this way. */
+	ut = &proc->p_uthreads[curthread->t_tid];
+	ut->ut_state = UT_FREE;
+	cv_broadcast(proc->p_threadscv, proc->p_threadslock);
+	lock_release(proc->p_threadslock);
+
+	proc_leave(proc, status);
+}
+
+/*
+ * Make the current thread exit, leaving STATUS for threadjoin.
+ */
+void
+proc_thread_exit(int status)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+
+	lock_acquire(proc->p_threadslock);
+	ut = &proc->p_uthreads[curthread->t_tid];
+	KASSERT(ut->ut_state == UT_RUNNING);
+	ut->ut_state = UT_EXITED;
+	ut->ut_status = status;
+	cv_broadcast(proc->p_threadscv, proc->p_threadslock);
+	lock_release(proc->p_threadslock);
+
+	proc_leave(proc, _MKWAIT_EXIT(status));
+}
+
+/*
+ * After execv has replaced the address space, only the regular stack
+ * exists, so the caller (which must be the only thread) becomes
+ * thread 0.
+ */
+void
+proc_resetthreads(void)
+{
+	struct proc *proc = curproc;
+	unsigned i;
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(threadarray_num(&proc->p_threads) == 1);
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		proc->p_uthreads[i].ut_state = UT_FREE;
+	}
+	proc->p_uthreads[0].ut_state = UT_RUNNING;
+	lock_release(proc->p_threadslock);
+
+	curthread->t_tid = 0;
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -416,39 +554,43 @@ void
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
-	unsigned num, i;
 	int spl;
 
 	proc = t->t_proc;
 	KASSERT(proc != NULL);
 
 	lock_acquire(proc->p_threadslock);
-	/* ugh: find the thread in the array */
-	num = threadarray_num(&proc->p_threads);
-	for (i=0; i<num; i++) {
-		if (threadarray_get(&proc->p_threads, i) == t) {
-			threadarray_remove(&proc->p_threads, i);
-			lock_release(proc->p_threadslock);
-			goto finish;
-		}
-	}
-	/* Did not find it. */
+	proc_dropthread(proc, t);
 	lock_release(proc->p_threadslock);
-	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 
-finish:
 	spl = splhigh();
 	t->t_proc = NULL;
 	splx(spl);
 }
 
+/*
+ * Return the number of threads in PROC. Unless PROC is the current
+ * process and the caller is its only thread, this can be stale by the
+ * time it's looked at.
+ */
+unsigned
+proc_numthreads(struct proc *proc)
+{
+	unsigned num;
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	lock_release(proc->p_threadslock);
+	return num;
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Address spaces aren't refcounted. This is safe because the address
+ * space is only destroyed by the last thread to leave the process (or
+ * replaced by execv, which refuses to run with other threads around),
+ * so it can't disappear under any thread still in the process.
  */
 struct addrspace *
 proc_getas(void)
@@ -37,6 +37,7 @@
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -45,8 +46,10 @@
 #include <copyinout.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <vm.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
 /*
@@ -107,18 +110,19 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 /*
  * Common logic for read and write.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE. The user buffers
+ * are described by the IOVCNT entries of IOV.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt, enum uio_rw rw,
 	      int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
 	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -142,8 +146,9 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers, their size, and the current offset */
+	uio_uinitv(iov, iovcnt, &useruio, pos, rw);
+	size = useruio.uio_resid;
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -177,13 +182,118 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for pread and pwrite.
+ *
+ * Like sys_readwrite, but at an explicit offset. The file's seek
+ * position is neither used nor changed, so we don't take the offset
+ * lock, and callers sharing an open file don't serialize on it.
+ */
+static
+int
+sys_preadwrite(int fd, struct iovec *iov, unsigned iovcnt, off_t pos,
+	       enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct openfile *file;
+	struct uio useruio;
+	size_t size;
+	int result;
+
+	/* better be a valid file descriptor */
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	/* Explicit offsets only make sense on seekable objects. */
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		result = ESPIPE;
+		goto out;
+	}
+
+	if (file->of_accmode == badaccmode) {
+		result = EBADF;
+		goto out;
+	}
+
+	if (pos < 0) {
+		result = EINVAL;
+		goto out;
+	}
+
+	/* set up a uio with the buffers, their size, and the given offset */
+	uio_uinitv(iov, iovcnt, &useruio, pos, rw);
+	size = useruio.uio_resid;
+
+	/* do the read or write */
+	result = (rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, &useruio) :
+		VOP_WRITE(file->of_vnode, &useruio);
+	if (result) {
+		goto out;
+	}
+
+	*retval = size - useruio.uio_resid;
+
+out:
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
+/*
+ * Copy in the iovec array for readv and friends, and check that the
+ * total length fits in the ssize_t they return. IOV_MAX is small enough that the
+ * array fits in the single page kmalloc can give us.
+ */
+static
+int
+iovec_copyin(const_userptr_t uiov, int iovcnt, struct iovec **ret)
+{
+	struct iovec *iov;
+	size_t total;
+	int i, result;
+
+	KASSERT(IOV_MAX * sizeof(*iov) <= PAGE_SIZE);
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	iov = kmalloc(iovcnt * sizeof(*iov));
+	if (iov == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		kfree(iov);
+		return result;
+	}
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > SSIZE_MAX - total) {
+			kfree(iov);
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+
+	*ret = iov;
+	return 0;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +302,157 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_preadwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_preadwrite(fd, &iov, 1, pos, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_preadwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_preadwrite(fd, &iov, 1, pos, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * readv() and writev() - copy in the iovecs, then use sys_readwrite
+ */
+int
+sys_readv(int fd, const_userptr_t uiov, int iovcnt, int *retval)
+{
+	struct iovec *iov;
+	int result;
+
+	result = iovec_copyin(uiov, iovcnt, &iov);
+	if (result) {
+		return result;
+	}
+	result = sys_readwrite(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+	kfree(iov);
+	return result;
+}
+
+int
+sys_writev(int fd, const_userptr_t uiov, int iovcnt, int *retval)
+{
+	struct iovec *iov;
+	int result;
+
+	result = iovec_copyin(uiov, iovcnt, &iov);
+	if (result) {
+		return result;
+	}
+	result = sys_readwrite(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+	kfree(iov);
+	return result;
+}
+
+/*
+ * preadv() and pwritev() - copy in the iovecs, then use sys_preadwrite
+ */
+int
+sys_preadv(int fd, const_userptr_t uiov, int iovcnt, off_t pos, int *retval)
+{
+	struct iovec *iov;
+	int result;
+
+	result = iovec_copyin(uiov, iovcnt, &iov);
+	if (result) {
+		return result;
+	}
+	result = sys_preadwrite(fd, iov, iovcnt, pos, UIO_READ, O_WRONLY,
+				retval);
+	kfree(iov);
+	return result;
+}
+
+int
+sys_pwritev(int fd, const_userptr_t uiov, int iovcnt, off_t pos, int *retval)
+{
+	struct iovec *iov;
+	int result;
+
+	result = iovec_copyin(uiov, iovcnt, &iov);
+	if (result) {
+		return result;
+	}
+	result = sys_preadwrite(fd, iov, iovcnt, pos, UIO_WRITE, O_RDONLY,
+				retval);
+	kfree(iov);
+	return result;
+}
+
+/*
+ * pipe() - make a pipe and put its two ends in the file table.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct vnode *rvn, *wvn;
+	struct openfile *rfile, *wfile;
+	int fds[2];
+	int result;
+
+	result = pipe_create(&rvn, &wvn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(rvn, O_RDONLY, &rfile);
+	if (result) {
+		vfs_close(rvn);
+		vfs_close(wvn);
+		return result;
+	}
+	result = openfile_fromvnode(wvn, O_WRONLY, &wfile);
+	if (result) {
+		openfile_decref(rfile);
+		vfs_close(wvn);
+		return result;
+	}
+
+	result = filetable_place(curproc->p_filetable, rfile, &fds[0]);
+	if (result) {
+		openfile_decref(rfile);
+		openfile_decref(wfile);
+		return result;
+	}
+	result = filetable_place(curproc->p_filetable, wfile, &fds[1]);
+	if (result) {
+		sys_close(fds[0]);
+		openfile_decref(wfile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		sys_close(fds[0]);
+		sys_close(fds[1]);
+		return result;
+	}
+
+	return 0;
 }
 
 /*
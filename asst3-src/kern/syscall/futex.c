@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: user-level wait and wake on a word of user memory.
+ *
+ * A user-level mutex or semaphore keeps its state in an int and only
+ * calls into the kernel when it has to block (futex_wait) or has to
+ * wake someone (futex_wake). futex_wait sleeps only if the word still
+ * has the value the caller last saw, so a wakeup that slips in
+ * between the caller's check and the system call is not lost.
+ *
+ * Waiters are keyed by (address space, user address) and kept in a
+ * fixed hash table. Each bucket has one wait channel; a waker picks
+ * out the matching waiters and wakes each of them individually with
+ * wchan_wakethread, so waiters on other addresses that share the
+ * bucket are left alone.
+ *
+ * The bucket's sleep lock makes fetching the user's word and getting
+ * on the waiter list atomic with respect to futex_wake. (The word is
+ * fetched with copyin, which can fault, so this can't be done under
+ * the spinlock.)
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <timer.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Number of hash buckets. Must be a power of 2. */
+#define FUTEX_BUCKETS 64
+
+/*
+ * A thread waiting in futex_wait. Lives on the waiter's stack.
+ */
+struct futex_waiter {
+	struct addrspace *fw_as;	/* Address space of the word */
+	vaddr_t fw_addr;		/* User address of the word */
+	struct thread *fw_thread;	/* The waiting thread */
+	bool fw_woken;			/* Set by futex_wake */
+	struct futex_waiter *fw_next;	/* Next waiter in bucket */
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;		/* Orders value checks and wakes */
+	struct spinlock fb_spinlock;	/* Protects fb_waiters and fb_wchan */
+	struct wchan *fb_wchan;		/* Where the waiters sleep */
+	struct futex_waiter *fb_waiters; /* List of waiters */
+};
+
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+/*
+ * Setup function
+ */
+void
+futex_bootstrap(void)
+{
+	struct futex_bucket *fb;
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		fb = &futex_table[i];
+		fb->fb_lock = lock_create("futex");
+		if (fb->fb_lock == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		spinlock_init(&fb->fb_spinlock);
+		fb->fb_wchan = wchan_create("futex");
+		if (fb->fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		fb->fb_waiters = NULL;
+	}
+}
+
+/*
+ * Find the bucket for the word at ADDR in address space AS.
+ */
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)as ^ (uint32_t)(addr >> 2);
+	h ^= h >> 16;
+	h ^= h >> 6;
+	return &futex_table[h & (FUTEX_BUCKETS - 1)];
+}
+
+/*
+ * Take waiter FW off its bucket's list. The bucket spinlock must be
+ * held.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **p;
+
+	KASSERT(spinlock_do_i_hold(&fb->fb_spinlock));
+
+	for (p = &fb->fb_waiters; *p != NULL; p = &(*p)->fw_next) {
+		if (*p == fw) {
+			*p = fw->fw_next;
+			fw->fw_next = NULL;
+			return;
+		}
+	}
+	panic("futex: waiter %p not in its bucket\n", fw);
+}
+
+/*
+ * futex_wait: if the int at user address ADDR still holds VAL, sleep
+ * until woken by futex_wake on the same address, or until the time
+ * in *USER_TIMEOUT (if not NULL) has passed. Returns EAGAIN if the
+ * value had already changed and ETIMEDOUT if the time ran out.
+ */
+int
+sys_futex_wait(userptr_t addr, int val, const_userptr_t user_timeout)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	struct timespec ts;
+	uint64_t nsecs = 0;
+	int cur;
+	int result;
+
+	if ((vaddr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	if (user_timeout != NULL) {
+		result = copyin(user_timeout, &ts, sizeof(ts));
+		if (result) {
+			return result;
+		}
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 ||
+		    ts.tv_nsec >= (int32_t)NSECS_PER_SEC) {
+			return EINVAL;
+		}
+		nsecs = (uint64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, (vaddr_t)addr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin(addr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+	if (user_timeout != NULL && nsecs == 0) {
+		lock_release(fb->fb_lock);
+		return ETIMEDOUT;
+	}
+
+	fw.fw_as = as;
+	fw.fw_addr = (vaddr_t)addr;
+	fw.fw_thread = curthread;
+	fw.fw_woken = false;
+
+	spinlock_acquire(&fb->fb_spinlock);
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+	lock_release(fb->fb_lock);
+
+	/*
+	 * Holding the spinlock until we're on the wait channel keeps
+	 * futex_wake from trying to wake us before we're asleep.
+	 */
+	result = 0;
+	while (!fw.fw_woken) {
+		if (user_timeout == NULL) {
+			wchan_sleep(fb->fb_wchan, &fb->fb_spinlock);
+		}
+		else if (!timer_wchan_sleep(fb->fb_wchan, &fb->fb_spinlock,
+					    nsecs)) {
+			/* A wake may have come in since the timer fired. */
+			if (!fw.fw_woken) {
+				futex_unlink(fb, &fw);
+				result = ETIMEDOUT;
+			}
+			break;
+		}
+	}
+	spinlock_release(&fb->fb_spinlock);
+
+	return result;
+}
+
+/*
+ * futex_wake: wake up to COUNT threads waiting in futex_wait on the
+ * int at user address ADDR. Returns the number woken.
+ */
+int
+sys_futex_wake(userptr_t addr, int count, int *retval)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex_waiter **p, *fw;
+	int woken = 0;
+
+	if ((vaddr_t)addr % sizeof(int) != 0 || count < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, (vaddr_t)addr);
+
+	lock_acquire(fb->fb_lock);
+	spinlock_acquire(&fb->fb_spinlock);
+	p = &fb->fb_waiters;
+	while (*p != NULL && woken < count) {
+		fw = *p;
+		if (fw->fw_as != as || fw->fw_addr != (vaddr_t)addr) {
+			p = &fw->fw_next;
+			continue;
+		}
+		*p = fw->fw_next;
+		fw->fw_next = NULL;
+		fw->fw_woken = true;
+		/* Not asleep if its timer just went off; that's ok. */
+		wchan_wakethread(fb->fb_wchan, &fb->fb_spinlock,
+				 fw->fw_thread);
+		woken++;
+	}
+	spinlock_release(&fb->fb_spinlock);
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
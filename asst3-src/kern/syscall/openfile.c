@@ -35,6 +35,7 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <lib.h>
+#include <atomic.h>
 #include <synch.h>
 #include <vfs.h>
 #include <openfile.h>
@@ -64,8 +65,6 @@ openfile_create(struct vnode *vn, int accmode)
 		return NULL;
 	}
 
-	spinlock_init(&file->of_reflock);
-
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
 	file->of_offset = 0;
@@ -85,7 +84,6 @@ openfile_destroy(struct openfile *file)
 	/* balance vfs_open with vfs_close (not VOP_DECREF) */
 	vfs_close(file->of_vnode);
 
-	spinlock_cleanup(&file->of_reflock);
 	lock_destroy(file->of_offsetlock);
 	kfree(file);
 }
@@ -116,15 +114,33 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap an already-open vnode (e.g. one end of a pipe) in an openfile
+ * object. On success the openfile takes over the caller's reference
+ * to the vnode.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
 void
 openfile_incref(struct openfile *file)
 {
-	spinlock_acquire(&file->of_reflock);
-	file->of_refcount++;
-	spinlock_release(&file->of_reflock);
+	KASSERT(file->of_refcount > 0);
+	atomic_add(&file->of_refcount, 1);
 }
 
 /*
@@ -134,16 +150,10 @@ openfile_incref(struct openfile *file)
 void
 openfile_decref(struct openfile *file)
 {
-	spinlock_acquire(&file->of_reflock);
+	KASSERT(file->of_refcount > 0);
 
 	/* if this is the last close of this file, free it up */
-	if (file->of_refcount == 1) {
-		spinlock_release(&file->of_reflock);
+	if (atomic_dec_and_test(&file->of_refcount)) {
 		openfile_destroy(file);
 	}
-	else {
-		KASSERT(file->of_refcount > 1);
-		file->of_refcount--;
-		spinlock_release(&file->of_reflock);
-	}
 }
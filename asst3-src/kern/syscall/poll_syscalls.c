@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * poll() and select().
+ *
+ * Both are done by poll_wait, which holds a reference to each open
+ * file for the duration (so the objects stay around while we're
+ * registered on them) and asks each one for its readiness with
+ * VOP_POLL. The first pass registers on every object; if nothing is
+ * ready we sleep until one of them calls pollq_wakeup, then look at
+ * everything again.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/limits.h>
+#include <kern/poll.h>
+#include <kern/select.h>
+#include <kern/time.h>
+#include <limits.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <timer.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+/*
+ * Check each file once, filling in the revents fields, and return
+ * how many have something to report. If READY isn't NULL, an entry
+ * only counts if its revents has one of the bits in READY[i]. If PS
+ * isn't NULL, register it with each file as well.
+ */
+static
+unsigned
+poll_scan(struct pollfd *fds, const short *ready, struct openfile **files,
+	  unsigned nfds, struct pollset *ps)
+{
+	unsigned i, nready;
+	int events;
+
+	nready = 0;
+	for (i=0; i<nfds; i++) {
+		if (fds[i].fd < 0) {
+			fds[i].revents = 0;
+			continue;
+		}
+		if (files[i] == NULL) {
+			fds[i].revents = POLLNVAL;
+			nready++;
+			continue;
+		}
+		events = fds[i].events & ~(POLLERR | POLLHUP | POLLNVAL);
+		fds[i].revents = VOP_POLL(files[i]->of_vnode, events, ps) &
+			(events | POLLERR | POLLHUP);
+		if (ready != NULL ? (fds[i].revents & ready[i]) != 0 :
+		    fds[i].revents != 0) {
+			nready++;
+		}
+	}
+	return nready;
+}
+
+/*
+ * Wait until at least one of FDS has something to report, or for at
+ * most NSECS nanoseconds unless FOREVER is set. Fills in the revents
+ * fields and hands back the number of entries that have any. READY
+ * is as for poll_scan.
+ */
+static
+int
+poll_wait(struct pollfd *fds, const short *ready, unsigned nfds,
+	  bool forever, uint64_t nsecs, unsigned *nready_ret)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile **files;
+	struct pollset *ps;
+	uint64_t deadline, now;
+	unsigned i, nready;
+
+	files = kmalloc(nfds * sizeof(files[0]));
+	if (files == NULL) {
+		return ENOMEM;
+	}
+	ps = pollset_create(nfds);
+	if (ps == NULL) {
+		kfree(files);
+		return ENOMEM;
+	}
+
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		if (fds[i].fd >= 0) {
+			/* leaves files[i] NULL if not open */
+			(void)filetable_get(ft, fds[i].fd, &files[i]);
+		}
+	}
+
+	deadline = timer_now() + nsecs;
+	nready = poll_scan(fds, ready, files, nfds, ps);
+	while (nready == 0) {
+		if (forever) {
+			pollset_wait(ps, 0);
+		}
+		else {
+			now = timer_now();
+			if (now >= deadline) {
+				break;
+			}
+			if (!pollset_wait(ps, deadline - now)) {
+				break;
+			}
+		}
+		nready = poll_scan(fds, ready, files, nfds, NULL);
+	}
+
+	/* Get off the wait queues before letting go of the files. */
+	pollset_destroy(ps);
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			filetable_put(ft, fds[i].fd, files[i]);
+		}
+	}
+	kfree(files);
+
+	*nready_ret = nready;
+	return 0;
+}
+
+/*
+ * poll() - TIMEOUT is in milliseconds; negative means wait forever.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollfd *fds;
+	unsigned nready;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fds = kmalloc(nfds * sizeof(fds[0]));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ufds, fds, nfds * sizeof(fds[0]));
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	result = poll_wait(fds, NULL, nfds, timeout < 0,
+			   (uint64_t)timeout * (NSECS_PER_SEC / 1000),
+			   &nready);
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	result = copyout(fds, ufds, nfds * sizeof(fds[0]));
+	kfree(fds);
+	if (result) {
+		return result;
+	}
+
+	*retval = nready;
+	return 0;
+}
+
+/*
+ * select() - the three sets become one pollfd per file handle that
+ * is in any of them, and the results are turned back into sets.
+ * TIMEOUT of NULL means wait forever.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, const_userptr_t utimeout, int *retval)
+{
+	/* the sets, in order, and what each one waits for */
+	userptr_t usets[3] = { ureadfds, uwritefds, uexceptfds };
+	static const short setevents[3] = { POLLIN, POLLOUT, POLLPRI };
+	static const short setrevents[3] = {
+		POLLIN | POLLHUP | POLLERR,
+		POLLOUT | POLLERR,
+		POLLPRI,
+	};
+
+	fd_set sets[3];
+	struct pollfd *fds;
+	short *ready;
+	struct timeval tv;
+	uint64_t nsecs;
+	unsigned i, j, n, nready;
+	int fd, total, result;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		return EINVAL;
+	}
+
+	for (j=0; j<3; j++) {
+		if (usets[j] == NULL) {
+			FD_ZERO(&sets[j]);
+			continue;
+		}
+		result = copyin(usets[j], &sets[j], sizeof(sets[j]));
+		if (result) {
+			return result;
+		}
+	}
+
+	nsecs = 0;
+	if (utimeout != NULL) {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 ||
+		    tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		nsecs = (uint64_t)tv.tv_sec * NSECS_PER_SEC +
+			(uint64_t)tv.tv_usec * 1000;
+	}
+
+	fds = kmalloc(nfds * sizeof(fds[0]));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	ready = kmalloc(nfds * sizeof(ready[0]));
+	if (ready == NULL) {
+		kfree(fds);
+		return ENOMEM;
+	}
+
+	/*
+	 * A file only counts as ready if it would show up in one of the
+	 * sets it's in. Otherwise, say, a hangup on a file we only want
+	 * to write would end the wait with nothing to report.
+	 */
+	n = 0;
+	for (fd=0; fd<nfds; fd++) {
+		fds[n].fd = fd;
+		fds[n].events = 0;
+		ready[n] = POLLNVAL;
+		for (j=0; j<3; j++) {
+			if (FD_ISSET(fd, &sets[j])) {
+				fds[n].events |= setevents[j];
+				ready[n] |= setrevents[j];
+			}
+		}
+		if (fds[n].events != 0) {
+			n++;
+		}
+	}
+
+	result = poll_wait(fds, ready, n, utimeout == NULL, nsecs, &nready);
+	kfree(ready);
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	total = 0;
+	for (j=0; j<3; j++) {
+		FD_ZERO(&sets[j]);
+	}
+	for (i=0; i<n; i++) {
+		if (fds[i].revents & POLLNVAL) {
+			kfree(fds);
+			return EBADF;
+		}
+		for (j=0; j<3; j++) {
+			if ((fds[i].events & setevents[j]) &&
+			    (fds[i].revents & setrevents[j])) {
+				FD_SET(fds[i].fd, &sets[j]);
+				total++;
+			}
+		}
+	}
+	kfree(fds);
+
+	for (j=0; j<3; j++) {
+		if (usets[j] == NULL) {
+			continue;
+		}
+		result = copyout(&sets[j], usets[j], sizeof(sets[j]));
+		if (result) {
+			return result;
+		}
+	}
+
+	*retval = total;
+	return 0;
+}
@@ -37,9 +37,11 @@
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
+#include <synch.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
+#include <addrspace.h>
 #include <copyinout.h>
 #include <pid.h>
 #include <syscall.h>
@@ -63,7 +65,8 @@ sys_getpid(pid_t *retval)
  *
  * The process-level work (exit status, waking up waiters, etc.)
  * happens in proc_exit(). Then call thread_exit() to make our thread
- * go away too.
+ * go away too. If the process has other threads, they keep running
+ * and the process is gone when the last of them exits.
  */
 __DEAD
 void
@@ -81,12 +84,13 @@ sys__exit(int status)
 
 static
 void
-fork_newthread(void *vtf, unsigned long junk)
+fork_newthread(void *vtf, unsigned long tid)
 {
 	struct trapframe mytf;
 	struct trapframe *ntf = vtf;
 
-	(void)junk;
+	/* We run on the forking thread's stack, so we keep its id. */
+	curthread->t_tid = tid;
 
 	/*
 	 * Now copy the trapframe to our stack, so we can free the one
@@ -127,7 +131,7 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	*retval = newproc->p_pid;
 
 	result = thread_fork(curthread->t_name, newproc,
-			     fork_newthread, ntf, 0);
+			     fork_newthread, ntf, curthread->t_tid);
 	if (result) {
 		proc_unfork(newproc);
 		kfree(ntf);
@@ -157,3 +161,178 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	}
 	return result;
 }
+
+/*
+ * sys___threadfork
+ *
+ * Create a new thread in the current process, sharing its address
+ * space and file table, which begins executing ENTRY(ARG) in user
+ * mode on a stack of its own. Returns the new thread's id.
+ */
+
+static
+void
+threadfork_newthread(void *vtf, unsigned long tid)
+{
+	struct trapframe mytf;
+	struct trapframe *ntf = vtf;
+
+	curthread->t_tid = tid;
+
+	/* Copy the trapframe to our stack, as in fork_newthread. */
+	mytf = *ntf;
+	kfree(ntf);
+
+	enter_new_thread(&mytf, (userptr_t)mytf.tf_a1, mytf.tf_sp,
+			 mytf.tf_a0);
+}
+
+int
+sys___threadfork(struct trapframe *tf, userptr_t entry, userptr_t arg,
+		 int *retval)
+{
+	struct proc *proc = curproc;
+	struct trapframe *ntf;
+	vaddr_t stackptr;
+	unsigned tid;
+	int result;
+
+	/* Claim a free thread slot. */
+	lock_acquire(proc->p_threadslock);
+	for (tid = 1; tid < PROC_MAXTHREADS; tid++) {
+		if (proc->p_uthreads[tid].ut_state == UT_FREE) {
+			break;
+		}
+	}
+	if (tid == PROC_MAXTHREADS) {
+		lock_release(proc->p_threadslock);
+		return EAGAIN;
+	}
+	proc->p_uthreads[tid].ut_state = UT_RUNNING;
+	lock_release(proc->p_threadslock);
+
+	result = as_define_threadstack(proc_getas(), tid, &stackptr);
+	if (result) {
+		goto fail;
+	}
+
+	/*
+	 * The new thread starts from a copy of our trapframe (for the
+	 * global pointer and such); it takes the entry point, argument
+	 * and stack out of a0, a1, and sp.
+	 */
+	ntf = kmalloc(sizeof(struct trapframe));
+	if (ntf == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	*ntf = *tf;
+	ntf->tf_a0 = (vaddr_t)entry;
+	ntf->tf_a1 = (vaddr_t)arg;
+	ntf->tf_sp = stackptr;
+
+	result = thread_fork(curthread->t_name, proc,
+			     threadfork_newthread, ntf, tid);
+	if (result) {
+		kfree(ntf);
+		goto fail;
+	}
+
+	*retval = tid;
+	return 0;
+
+ fail:
+	lock_acquire(proc->p_threadslock);
+	proc->p_uthreads[tid].ut_state = UT_FREE;
+	lock_release(proc->p_threadslock);
+	return result;
+}
+
+/*
+ * sys_threadexit
+ *
+ * Exit the current thread, leaving STATUS for threadjoin.
+ */
+__DEAD
+void
+sys_threadexit(int status)
+{
+	proc_thread_exit(status);
+}
+
+/*
+ * sys_threadjoin
+ *
+ * Wait for thread TID of the current process to exit and collect its
+ * exit status. Each thread can be joined once; a thread that left
+ * with _exit can't be joined at all.
+ */
+int
+sys_threadjoin(int tid, userptr_t retstatus)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	int status;
+
+	if (tid < 0 || tid >= PROC_MAXTHREADS) {
+		return ESRCH;
+	}
+	if ((unsigned)tid == curthread->t_tid) {
+		/* Would wait for ourselves forever. */
+		return EINVAL;
+	}
+
+	ut = &proc->p_uthreads[tid];
+
+	lock_acquire(proc->p_threadslock);
+	while (ut->ut_state == UT_RUNNING) {
+		cv_wait(proc->p_threadscv, proc->p_threadslock);
+	}
+	if (ut->ut_state != UT_EXITED) {
+		lock_release(proc->p_threadslock);
+		return ESRCH;
+	}
+	status = ut->ut_status;
+	ut->ut_state = UT_FREE;
+	lock_release(proc->p_threadslock);
+
+	if (retstatus != NULL) {
+		return copyout(&status, retstatus, sizeof(int));
+	}
+	return 0;
+}
+
+/*
+ * sys_setaffinity
+ *
+ * Restrict every thread of the current process to the cpus in MASK,
+ * bit N standing for cpu N. Threads the process creates later inherit
+ * the mask from their creator.
+ */
+int
+sys_setaffinity(unsigned mask)
+{
+	struct proc *proc = curproc;
+	struct thread *t;
+	unsigned i, num;
+	int result;
+
+	/* This checks the mask, and moves us if need be. */
+	result = thread_setaffinity(curthread, mask);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t != curthread) {
+			result = thread_setaffinity(t, mask);
+			KASSERT(result == 0);
+		}
+	}
+	lock_release(proc->p_threadslock);
+
+	return 0;
+}
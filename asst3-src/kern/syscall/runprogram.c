@@ -560,6 +560,16 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	int argc;
 	int result;
 
+	/*
+	 * We have no way to stop the process's other threads, and they
+	 * can't keep running in an address space we're about to throw
+	 * away. Only the caller can add threads, so this can't change
+	 * under us.
+	 */
+	if (proc_numthreads(curproc) > 1) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -594,6 +604,9 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	/* don't need this any more */
 	kfree(path);
 
+	/* The old thread stacks went away with the old address space. */
+	proc_resetthreads();
+
 	/* Send the argv strings to the process. */
 	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
 	if (result) {
@@ -28,7 +28,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
+#include <timer.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +58,37 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the interval in *user_req. There are no signals, so the
+ * sleep is never cut short and the time remaining, if requested, is
+ * always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 ||
+	    req.tv_nsec >= (int32_t)NSECS_PER_SEC) {
+		return EINVAL;
+	}
+
+	timer_sleep((uint64_t)req.tv_sec * NSECS_PER_SEC + req.tv_nsec);
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Spinlock microbenchmark.
+ *
+ * For each kind of spinlock, runs 1, 2, 4, ... threads (up to one per
+ * cpu, at most 32) that all hammer one lock, and reports throughput
+ * and the worst-case wait. The wait is measured in handoffs: how many
+ * times other threads got the lock while a thread was waiting for it.
+ * That shows fairness directly and doesn't depend on the cost of
+ * reading the clock inside the loop. It's approximate: the count is
+ * sampled before the lock is asked for, so threads that get in just
+ * before that are counted too. Even with a ticket lock it can come
+ * out somewhat above one less than the number of threads; what shows
+ * unfairness is a value many times that.
+ */
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+#define SLB_MAXTHREADS	32
+#define SLB_ITERS	20000
+
+static struct spinlock slb_lock;
+static volatile unsigned slb_count;	/* acquisitions; protected by slb_lock */
+static volatile bool slb_go;
+static struct semaphore *slb_ready;
+static struct semaphore *slb_done;
+static unsigned slb_maxwait[SLB_MAXTHREADS];
+
+static
+void
+slb_thread(void *junk, unsigned long num)
+{
+	unsigned i, before, waited, maxwait;
+
+	(void)junk;
+
+	V(slb_ready);
+	while (!slb_go) {
+		/* let the scheduler spread us over the cpus */
+		thread_yield();
+	}
+
+	maxwait = 0;
+	for (i=0; i<SLB_ITERS; i++) {
+		/*
+		 * Unlocked read, before we take a ticket; handoffs in
+		 * between (or a stale value) make waited bigger.
+		 */
+		before = slb_count;
+		spinlock_acquire(&slb_lock);
+		waited = slb_count - before;
+		slb_count++;
+		spinlock_release(&slb_lock);
+		if (waited > maxwait) {
+			maxwait = waited;
+		}
+	}
+	slb_maxwait[num] = maxwait;
+	V(slb_done);
+}
+
+static
+void
+slb_run(unsigned kind, unsigned nthreads)
+{
+	uint64_t start, elapsed;
+	unsigned i, maxwait;
+	int result;
+
+	spinlock_init_kind(&slb_lock, kind);
+	slb_count = 0;
+	slb_go = false;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("slb", NULL, slb_thread, NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(slb_ready);
+	}
+
+	start = timer_now();
+	slb_go = true;
+	for (i=0; i<nthreads; i++) {
+		P(slb_done);
+	}
+	elapsed = timer_now() - start;
+
+	KASSERT(slb_count == nthreads * SLB_ITERS);
+	maxwait = 0;
+	for (i=0; i<nthreads; i++) {
+		if (slb_maxwait[i] > maxwait) {
+			maxwait = slb_maxwait[i];
+		}
+	}
+	spinlock_cleanup(&slb_lock);
+
+	kprintf("%-6s %2u threads: %8llu acquires/sec, max wait %u\n",
+		kind == SPINLOCK_TICKET ? "ticket" : "tas", nthreads,
+		elapsed == 0 ? 0 :
+		(uint64_t)slb_count * NSECS_PER_SEC / elapsed,
+		maxwait);
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned maxthreads, n;
+
+	(void)nargs;
+	(void)args;
+
+	maxthreads = cpu_numcpus();
+	if (maxthreads > SLB_MAXTHREADS) {
+		maxthreads = SLB_MAXTHREADS;
+	}
+
+	slb_ready = sem_create("slb_ready", 0);
+	slb_done = sem_create("slb_done", 0);
+	if (slb_ready == NULL || slb_done == NULL) {
+		panic("spinlockbench: sem_create failed\n");
+	}
+
+	kprintf("Starting spinlock benchmark (%u cpus)...\n",
+		cpu_numcpus());
+	for (n = 1; n <= maxthreads; n *= 2) {
+		slb_run(SPINLOCK_TAS, n);
+		slb_run(SPINLOCK_TICKET, n);
+	}
+	if ((maxthreads & (maxthreads - 1)) != 0) {
+		/* not a power of 2; also do the full count */
+		slb_run(SPINLOCK_TAS, maxthreads);
+		slb_run(SPINLOCK_TICKET, maxthreads);
+	}
+
+	sem_destroy(slb_done);
+	sem_destroy(slb_ready);
+
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
@@ -400,3 +400,203 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// reader/writer lock test
+
+#define NRWLOOPS 100
+
+static struct rwlock *testrw;
+static struct spinlock rwcountlock = SPINLOCK_INITIALIZER;
+static unsigned rwnreaders;	/* threads inside for read */
+static unsigned rwnwriters;	/* threads inside for write */
+static unsigned rwfailures;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	spinlock_acquire(&rwcountlock);
+	rwfailures++;
+	spinlock_release(&rwcountlock);
+}
+
+/*
+ * Note entering and leaving the lock, checking that nobody is in
+ * there who shouldn't be.
+ */
+static
+void
+rwenter(unsigned long num, bool write)
+{
+	bool bad;
+
+	spinlock_acquire(&rwcountlock);
+	if (write) {
+		bad = rwnreaders > 0 || rwnwriters > 0;
+		rwnwriters++;
+	}
+	else {
+		bad = rwnwriters > 0;
+		rwnreaders++;
+	}
+	spinlock_release(&rwcountlock);
+	if (bad) {
+		rwfail(num, write ? "Writer got in with others inside" :
+		       "Reader got in with a writer inside");
+	}
+}
+
+static
+void
+rwleave(bool write)
+{
+	spinlock_acquire(&rwcountlock);
+	if (write) {
+		KASSERT(rwnwriters > 0);
+		rwnwriters--;
+	}
+	else {
+		KASSERT(rwnreaders > 0);
+		rwnreaders--;
+	}
+	spinlock_release(&rwcountlock);
+}
+
+/*
+ * Change testval1 and testval2 in two steps, with a yield in between
+ * so any reader that gets in sees them disagree.
+ */
+static
+void
+rwmodify(unsigned long num)
+{
+	testval1 = num;
+	thread_yield();
+	testval2 = num;
+}
+
+static
+void
+rwcheck(unsigned long num)
+{
+	unsigned long v1, v2;
+
+	v1 = testval1;
+	thread_yield();
+	v2 = testval2;
+	if (v1 != v2) {
+		rwfail(num, "Reader saw a write in progress");
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	unsigned long seen;
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		switch ((num + i) % 4) {
+		    case 0:
+			rwlock_acquire_read(testrw);
+			rwenter(num, false);
+			rwcheck(num);
+			rwleave(false);
+			rwlock_release_read(testrw);
+			break;
+		    case 1:
+			rwlock_acquire_write(testrw);
+			rwenter(num, true);
+			rwmodify(num);
+			rwleave(true);
+			rwlock_release_write(testrw);
+			break;
+		    case 2:
+			/*
+			 * Upgrade: nobody may write between what we
+			 * saw shared and getting the lock exclusive.
+			 */
+			rwlock_acquire_read(testrw);
+			rwenter(num, false);
+			seen = testval1;
+			rwleave(false);
+			if (!rwlock_upgrade(testrw)) {
+				/* Someone else is upgrading; start over */
+				rwlock_release_read(testrw);
+				rwlock_acquire_write(testrw);
+				seen = testval1;
+			}
+			rwenter(num, true);
+			if (testval1 != seen) {
+				rwfail(num, "Write got in during upgrade");
+			}
+			rwmodify(num);
+			rwleave(true);
+			rwlock_release_write(testrw);
+			break;
+		    case 3:
+			/*
+			 * Downgrade: nobody may write between our write
+			 * and what we see shared afterwards.
+			 */
+			rwlock_acquire_write(testrw);
+			rwenter(num, true);
+			rwmodify(num);
+			rwleave(true);
+			rwlock_downgrade(testrw);
+			rwenter(num, false);
+			thread_yield();
+			if (testval1 != num || testval2 != num) {
+				rwfail(num, "Write got in during downgrade");
+			}
+			rwleave(false);
+			rwlock_release_read(testrw);
+			break;
+		}
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwnreaders = rwnwriters = rwfailures = 0;
+	testval1 = testval2 = 0;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+
+	if (rwfailures > 0) {
+		kprintf("Test failed (%u errors)\n", rwfailures);
+	}
+	kprintf("Rwlock test done.\n");
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Timer test code.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+static const uint64_t sleeptimes[] = {
+	100000ULL,		/* 100 us */
+	1000000ULL,		/* 1 ms */
+	5000000ULL,		/* 5 ms */
+	25000000ULL,		/* 25 ms */
+};
+#define NSLEEPTIMES (sizeof(sleeptimes) / sizeof(sleeptimes[0]))
+
+static struct lock *tmt_lock;
+static struct cv *tmt_cv;
+static struct semaphore *tmt_done;
+static volatile bool tmt_flag;
+
+static
+void
+tmt_signaller(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	timer_sleep(2000000ULL);
+	lock_acquire(tmt_lock);
+	tmt_flag = true;
+	cv_signal(tmt_cv, tmt_lock);
+	lock_release(tmt_lock);
+	V(tmt_done);
+}
+
+int
+timertest(int nargs, char **args)
+{
+	uint64_t start, elapsed;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting timer test...\n");
+
+	for (i = 0; i < NSLEEPTIMES; i++) {
+		start = timer_now();
+		timer_sleep(sleeptimes[i]);
+		elapsed = timer_now() - start;
+		kprintf("Slept %llu ns, asked for %llu\n",
+			elapsed, sleeptimes[i]);
+		if (elapsed < sleeptimes[i]) {
+			panic("timertest: woke up early\n");
+		}
+	}
+
+	tmt_lock = lock_create("timertest");
+	tmt_cv = cv_create("timertest");
+	tmt_done = sem_create("timertest", 0);
+	if (tmt_lock == NULL || tmt_cv == NULL || tmt_done == NULL) {
+		panic("timertest: out of memory\n");
+	}
+
+	/* Nobody signals: must time out. */
+	lock_acquire(tmt_lock);
+	result = cv_wait_timeout(tmt_cv, tmt_lock, 1000000ULL);
+	lock_release(tmt_lock);
+	if (result != ETIMEDOUT) {
+		panic("timertest: cv_wait_timeout returned %d, "
+		      "expected ETIMEDOUT\n", result);
+	}
+
+	/* Signalled well before the deadline: must not time out. */
+	tmt_flag = false;
+	result = thread_fork("timertest", NULL, tmt_signaller, NULL, 0);
+	if (result) {
+		panic("timertest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	lock_acquire(tmt_lock);
+	result = 0;
+	while (!tmt_flag && result == 0) {
+		result = cv_wait_timeout(tmt_cv, tmt_lock,
+					 1000ULL * NSECS_PER_SEC);
+	}
+	lock_release(tmt_lock);
+	P(tmt_done);
+	if (result != 0) {
+		panic("timertest: cv_wait_timeout timed out\n");
+	}
+
+	sem_destroy(tmt_done);
+	cv_destroy(tmt_cv);
+	lock_destroy(tmt_lock);
+
+	kprintf("Timer test done.\n");
+	return 0;
+}
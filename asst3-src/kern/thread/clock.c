@@ -34,13 +34,16 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <prof.h>
+#include <schedstat.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * This is pretty primitive. Callbacks at specific points in the
+ * future, with better than one-second resolution, are handled by the
+ * timer code in timer.c; that is also what decides when hardclock()
+ * is called.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -97,6 +100,12 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+#if OPT_PROF
+	prof_sample();
+#endif
+#if OPT_SCHEDSTAT
+	schedstat_hardclock();
+#endif
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Per-cpu event counters. See <cpustat.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <atomic.h>
+#include <cpu.h>
+#include <current.h>
+#include <cpustat.h>
+
+static const char *const cpustat_names[NCPUSTATS] = {
+	"syscalls",
+	"vm faults",
+	"switches",
+	"interrupts",
+	"disk sectors",
+	"ncache hits",
+	"ncache misses",
+};
+
+void
+cpustat_add(unsigned which, unsigned n)
+{
+	KASSERT(which < NCPUSTATS);
+
+	/*
+	 * No spl or lock: atomic_add is atomic with respect to
+	 * interrupts on this cpu, and the line is normally only
+	 * written by this cpu, so it stays in our cache.
+	 */
+	atomic_add((volatile int *)&curcpu->c_stats[which], (int)n);
+}
+
+uint64_t
+cpustat_get(unsigned which)
+{
+	unsigned i, num;
+	uint64_t total;
+
+	KASSERT(which < NCPUSTATS);
+
+	total = 0;
+	num = cpu_numcpus();
+	for (i=0; i<num; i++) {
+		total += cpu_get(i)->c_stats[which];
+	}
+	return total;
+}
+
+void
+cpustat_reset(void)
+{
+	unsigned i, j, num;
+	struct cpu *c;
+
+	num = cpu_numcpus();
+	for (i=0; i<num; i++) {
+		c = cpu_get(i);
+		for (j=0; j<NCPUSTATS; j++) {
+			c->c_stats[j] = 0;
+		}
+	}
+}
+
+void
+cpustat_dump(void)
+{
+	unsigned i, j, num;
+
+	num = cpu_numcpus();
+
+	kprintf("%-14s", "");
+	for (i=0; i<num; i++) {
+		kprintf("      cpu%-3u", i);
+	}
+	kprintf("        total\n");
+
+	for (j=0; j<NCPUSTATS; j++) {
+		kprintf("%-14s", cpustat_names[j]);
+		for (i=0; i<num; i++) {
+			kprintf(" %11u", cpu_get(i)->c_stats[j]);
+		}
+		kprintf(" %12llu\n", (unsigned long long)cpustat_get(j));
+	}
+}
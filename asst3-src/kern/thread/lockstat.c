@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <timer.h>
+#include <lockstat.h>
+
+/* Significant characters of lock names */
+#define LOCKSTAT_NAMELEN	16
+
+/* Entries per cpu table; chosen so a table fits in one page. */
+#define LOCKSTAT_ENTRIES	80
+
+/* Give up looking for a free slot after this many probes. */
+#define LOCKSTAT_MAXPROBE	8
+
+struct lockstat_entry {
+	char lse_name[LOCKSTAT_NAMELEN];	/* name; empty if unused */
+	const void *lse_pc;			/* acquire site (spinlocks) */
+	unsigned lse_kind;			/* LOCKSTAT_* */
+	unsigned lse_acquires;			/* number of acquisitions */
+	unsigned lse_contended;			/* number that had to wait */
+	uint64_t lse_waittime;			/* total time spent waiting */
+	uint64_t lse_maxhold;			/* longest hold */
+};
+
+struct lockstat_table {
+	unsigned lst_dropped;		/* events with no room in the table */
+	struct lockstat_entry lst_entries[LOCKSTAT_ENTRIES];
+};
+
+/* Set once timer_now() works. */
+static volatile bool lockstat_enabled;
+
+struct lockstat_table *
+lockstat_table_create(void)
+{
+	struct lockstat_table *lst;
+
+	COMPILE_ASSERT(sizeof(struct lockstat_table) <= PAGE_SIZE);
+
+	lst = kmalloc(sizeof(*lst));
+	if (lst == NULL) {
+		return NULL;
+	}
+	bzero(lst, sizeof(*lst));
+	return lst;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	if (!lockstat_enabled) {
+		return 0;
+	}
+	return timer_now();
+}
+
+/*
+ * Hash a lock's identity.
+ */
+static
+unsigned
+lockstat_hash(unsigned kind, const char *name, const void *pc)
+{
+	unsigned h, i;
+
+	h = kind;
+	if (kind == LOCKSTAT_SPINLOCK) {
+		h += (uintptr_t)pc >> 2;
+	}
+	else {
+		for (i = 0; i < LOCKSTAT_NAMELEN - 1 && name[i] != 0; i++) {
+			h = h * 33 + (unsigned char)name[i];
+		}
+	}
+	return h;
+}
+
+/*
+ * Check if entry LSE is the lock identified by KIND/NAME/PC.
+ */
+static
+bool
+lockstat_match(struct lockstat_entry *lse, unsigned kind,
+	       const char *name, const void *pc)
+{
+	unsigned i;
+
+	if (lse->lse_kind != kind) {
+		return false;
+	}
+	if (kind == LOCKSTAT_SPINLOCK) {
+		return lse->lse_pc == pc;
+	}
+	for (i = 0; i < LOCKSTAT_NAMELEN - 1; i++) {
+		if (lse->lse_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the entry for a lock in table LST. Returns NULL if
+ * the table is too full.
+ */
+static
+struct lockstat_entry *
+lockstat_find(struct lockstat_table *lst, unsigned kind, const char *name,
+	      const void *pc)
+{
+	struct lockstat_entry *lse;
+	unsigned h, i, j;
+
+	if (kind != LOCKSTAT_SPINLOCK && name[0] == 0) {
+		/* empty names would look like free slots */
+		name = "?";
+	}
+
+	h = lockstat_hash(kind, name, pc);
+	for (i = 0; i < LOCKSTAT_MAXPROBE; i++) {
+		lse = &lst->lst_entries[(h + i) % LOCKSTAT_ENTRIES];
+		if (lse->lse_name[0] == 0) {
+			/* free slot; claim it */
+			if (kind == LOCKSTAT_SPINLOCK) {
+				snprintf(lse->lse_name, LOCKSTAT_NAMELEN,
+					 "spin@%p", pc);
+			}
+			else {
+				for (j = 0; j < LOCKSTAT_NAMELEN - 1 &&
+					     name[j] != 0; j++) {
+					lse->lse_name[j] = name[j];
+				}
+				lse->lse_name[j] = 0;
+			}
+			lse->lse_kind = kind;
+			lse->lse_pc = pc;
+			return lse;
+		}
+		if (lockstat_match(lse, kind, name, pc)) {
+			return lse;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Get the current cpu's table with interrupts off, or NULL if we're
+ * not collecting.
+ */
+static
+struct lockstat_table *
+lockstat_mytable(void)
+{
+	if (!lockstat_enabled || !CURCPU_EXISTS()) {
+		return NULL;
+	}
+	return curcpu->c_lockstat;
+}
+
+uint64_t
+lockstat_acquired(unsigned kind, const char *name, const void *pc,
+		  uint64_t waitstart)
+{
+	struct lockstat_table *lst;
+	struct lockstat_entry *lse;
+	uint64_t now;
+	int spl;
+
+	spl = splhigh();
+	lst = lockstat_mytable();
+	if (lst == NULL) {
+		splx(spl);
+		return 0;
+	}
+	now = timer_now();
+
+	lse = lockstat_find(lst, kind, name, pc);
+	if (lse == NULL) {
+		lst->lst_dropped++;
+	}
+	else {
+		lse->lse_acquires++;
+		if (waitstart != 0) {
+			lse->lse_contended++;
+			lse->lse_waittime += now - waitstart;
+		}
+	}
+	splx(spl);
+	return now;
+}
+
+void
+lockstat_released(unsigned kind, const char *name, const void *pc,
+		  uint64_t acquired)
+{
+	struct lockstat_table *lst;
+	struct lockstat_entry *lse;
+	uint64_t hold;
+	int spl;
+
+	if (acquired == 0) {
+		/* weren't collecting when it was acquired */
+		return;
+	}
+
+	spl = splhigh();
+	lst = lockstat_mytable();
+	if (lst == NULL) {
+		splx(spl);
+		return;
+	}
+	hold = timer_now() - acquired;
+
+	lse = lockstat_find(lst, kind, name, pc);
+	if (lse == NULL) {
+		lst->lst_dropped++;
+	}
+	else if (hold > lse->lse_maxhold) {
+		lse->lse_maxhold = hold;
+	}
+	splx(spl);
+}
+
+/*
+ * Fold entry LSE (from some cpu's table) into the merged table.
+ */
+static
+void
+lockstat_merge(struct lockstat_table *merged, struct lockstat_entry *lse)
+{
+	struct lockstat_entry *m;
+
+	m = lockstat_find(merged, lse->lse_kind, lse->lse_name, lse->lse_pc);
+	if (m == NULL) {
+		merged->lst_dropped += lse->lse_acquires;
+		return;
+	}
+	m->lse_acquires += lse->lse_acquires;
+	m->lse_contended += lse->lse_contended;
+	m->lse_waittime += lse->lse_waittime;
+	if (lse->lse_maxhold > m->lse_maxhold) {
+		m->lse_maxhold = lse->lse_maxhold;
+	}
+}
+
+void
+lockstat_dump(void)
+{
+	static const char *const kindnames[] = { "spin", "lock", "sem", "cv" };
+	struct lockstat_table *merged, *lst;
+	struct lockstat_entry *lse;
+	unsigned i, j, numcpus;
+
+	merged = lockstat_table_create();
+	if (merged == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	/*
+	 * The other cpus keep updating their tables while we read
+	 * them, so the totals may be slightly inconsistent.
+	 */
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		lst = cpu_get(i)->c_lockstat;
+		if (lst == NULL) {
+			continue;
+		}
+		merged->lst_dropped += lst->lst_dropped;
+		for (j = 0; j < LOCKSTAT_ENTRIES; j++) {
+			lse = &lst->lst_entries[j];
+			if (lse->lse_name[0] != 0) {
+				lockstat_merge(merged, lse);
+			}
+		}
+	}
+
+	kprintf("%-4s %-16s %10s %10s %14s %12s\n", "kind", "name",
+		"acquires", "contended", "wait ns", "max hold ns");
+	for (j = 0; j < LOCKSTAT_ENTRIES; j++) {
+		lse = &merged->lst_entries[j];
+		if (lse->lse_name[0] == 0) {
+			continue;
+		}
+		kprintf("%-4s %-16s %10u %10u %14llu %12llu\n",
+			kindnames[lse->lse_kind], lse->lse_name,
+			lse->lse_acquires, lse->lse_contended,
+			lse->lse_waittime, lse->lse_maxhold);
+	}
+	if (merged->lst_dropped > 0) {
+		kprintf("(%u events not recorded; table full)\n",
+			merged->lst_dropped);
+	}
+
+	kfree(merged);
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat_table *lst;
+	unsigned i, numcpus;
+	int spl;
+
+	/* As in lockstat_dump, this races with the other cpus. */
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		lst = cpu_get(i)->c_lockstat;
+		if (lst != NULL) {
+			spl = splhigh();
+			bzero(lst, sizeof(*lst));
+			splx(spl);
+		}
+	}
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_enabled = true;
+}
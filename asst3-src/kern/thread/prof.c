@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Sampling kernel profiler. See prof.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <vm.h>
+#include <prof.h>
+#include <lamebus/ltrace.h>
+
+/* Entries per cpu table; chosen so a table fits in one page. */
+#define PROF_ENTRIES		500
+
+/* Give up looking for a free slot after this many probes. */
+#define PROF_MAXPROBE		8
+
+/* End of kernel text, from the linker script. */
+extern char _etext[];
+
+struct prof_entry {
+	vaddr_t pe_pc;			/* sampled PC; 0 if unused */
+	unsigned pe_count;		/* number of samples */
+};
+
+struct prof_table {
+	unsigned pt_user;		/* samples in user mode */
+	unsigned pt_idle;		/* samples in the idle loop */
+	unsigned pt_kernel;		/* samples elsewhere in the kernel */
+	unsigned pt_dropped;		/* kernel samples with no room */
+	struct prof_entry pt_entries[PROF_ENTRIES];
+};
+
+/* Whether to sample. */
+static volatile bool prof_enabled;
+
+struct prof_table *
+prof_table_create(void)
+{
+	struct prof_table *pt;
+
+	COMPILE_ASSERT(sizeof(struct prof_table) <= PAGE_SIZE);
+
+	pt = kmalloc(sizeof(*pt));
+	if (pt == NULL) {
+		return NULL;
+	}
+	bzero(pt, sizeof(*pt));
+	return pt;
+}
+
+/*
+ * Find (or make) the entry for PC in table PT. Returns NULL if the
+ * table is too full.
+ */
+static
+struct prof_entry *
+prof_find(struct prof_table *pt, vaddr_t pc)
+{
+	struct prof_entry *pe;
+	unsigned h, i;
+
+	h = (pc >> 2) % PROF_ENTRIES;
+	for (i = 0; i < PROF_MAXPROBE; i++) {
+		pe = &pt->pt_entries[(h + i) % PROF_ENTRIES];
+		if (pe->pe_pc == pc) {
+			return pe;
+		}
+		if (pe->pe_pc == 0) {
+			pe->pe_pc = pc;
+			return pe;
+		}
+	}
+	return NULL;
+}
+
+void
+prof_sample(void)
+{
+	struct prof_table *pt;
+	struct prof_entry *pe;
+	vaddr_t pc;
+
+	/* hardclock runs with interrupts off */
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!prof_enabled) {
+		return;
+	}
+	pt = curcpu->c_prof;
+
+	if (curcpu->c_intruser) {
+		pt->pt_user++;
+		return;
+	}
+	if (curcpu->c_isidle) {
+		/* Interrupted in cpu_idle; not interesting. */
+		pt->pt_idle++;
+		return;
+	}
+
+	pt->pt_kernel++;
+	pc = curcpu->c_intrpc;
+	if (pc >= (vaddr_t)_etext) {
+		/* Not in kernel text; shouldn't happen, but be safe. */
+		pc = 1;
+	}
+	pe = prof_find(pt, pc);
+	if (pe == NULL) {
+		pt->pt_dropped++;
+	}
+	else {
+		pe->pe_count++;
+	}
+}
+
+void
+prof_start(void)
+{
+	prof_enabled = true;
+	ltrace_setprof(1);
+}
+
+void
+prof_stop(void)
+{
+	ltrace_setprof(0);
+	prof_enabled = false;
+}
+
+void
+prof_dump(void)
+{
+	struct prof_table *merged, *pt;
+	struct prof_entry *pe, *m, *best;
+	unsigned i, j, numcpus, total;
+
+	merged = prof_table_create();
+	if (merged == NULL) {
+		kprintf("prof: Out of memory\n");
+		return;
+	}
+
+	/*
+	 * The other cpus keep sampling while we read their tables,
+	 * so the totals may be slightly inconsistent.
+	 */
+	kprintf("%-4s %10s %10s %10s\n", "cpu", "user", "kernel", "idle");
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		pt = cpu_get(i)->c_prof;
+		kprintf("%-4u %10u %10u %10u\n", i,
+			pt->pt_user, pt->pt_kernel, pt->pt_idle);
+		merged->pt_user += pt->pt_user;
+		merged->pt_kernel += pt->pt_kernel;
+		merged->pt_idle += pt->pt_idle;
+		merged->pt_dropped += pt->pt_dropped;
+		for (j = 0; j < PROF_ENTRIES; j++) {
+			pe = &pt->pt_entries[j];
+			if (pe->pe_pc == 0) {
+				continue;
+			}
+			m = prof_find(merged, pe->pe_pc);
+			if (m == NULL) {
+				merged->pt_dropped += pe->pe_count;
+			}
+			else {
+				m->pe_count += pe->pe_count;
+			}
+		}
+	}
+	kprintf("%-4s %10u %10u %10u\n", "all",
+		merged->pt_user, merged->pt_kernel, merged->pt_idle);
+
+	/*
+	 * Print kernel samples, most frequent first. This is
+	 * quadratic, but the table is small and this is not a hot
+	 * path. Entries are zeroed as they are printed.
+	 */
+	total = merged->pt_kernel;
+	while (1) {
+		best = NULL;
+		for (j = 0; j < PROF_ENTRIES; j++) {
+			pe = &merged->pt_entries[j];
+			if (pe->pe_count > 0 &&
+			    (best == NULL || pe->pe_count > best->pe_count)) {
+				best = pe;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		if (best->pe_pc == 1) {
+			kprintf("%-10s %8u %3u%%\n", "(unknown)",
+				best->pe_count, best->pe_count * 100 / total);
+		}
+		else {
+			kprintf("0x%08x %8u %3u%%\n", best->pe_pc,
+				best->pe_count, best->pe_count * 100 / total);
+		}
+		best->pe_count = 0;
+	}
+	if (merged->pt_dropped > 0) {
+		kprintf("(%u samples not recorded; table full)\n",
+			merged->pt_dropped);
+	}
+
+	kfree(merged);
+}
+
+void
+prof_reset(void)
+{
+	struct prof_table *pt;
+	unsigned i, numcpus;
+	int spl;
+
+	/* As in prof_dump, this races with the other cpus. */
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		pt = cpu_get(i)->c_prof;
+		spl = splhigh();
+		bzero(pt, sizeof(*pt));
+		splx(spl);
+	}
+	ltrace_eraseprof();
+}
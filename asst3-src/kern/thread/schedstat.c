@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Scheduler statistics. See schedstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <atomic.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <timer.h>
+#include <schedstat.h>
+
+/* Set once timer_now() works. */
+static volatile bool schedstat_enabled;
+
+/*
+ * Histogram bucket for value V.
+ */
+static
+unsigned
+schedstat_bucket(uint64_t v)
+{
+	unsigned b;
+
+	b = 0;
+	while (v != 0 && b < SCHEDSTAT_BUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Thread T is going on its cpu's run queue, whose lock we hold.
+ */
+void
+schedstat_enqueue(struct thread *t)
+{
+	KASSERT(spinlock_do_i_hold(&t->t_cpu->c_runqueue_lock));
+
+	t->t_readysince = schedstat_enabled ? timer_now() : 0;
+}
+
+/*
+ * The current cpu is switching from CUR to NEXT. PREEMPTED is true
+ * if CUR is being switched out by hardclock rather than by choice.
+ */
+void
+schedstat_switch(struct thread *cur, struct thread *next, bool preempted)
+{
+	struct schedstat *ss = &curcpu->c_schedstat;
+
+	KASSERT(spinlock_do_i_hold(&curcpu->c_runqueue_lock));
+
+	if (next != cur) {
+		if (preempted) {
+			ss->ss_involuntary++;
+		}
+		else {
+			ss->ss_voluntary++;
+		}
+	}
+	if (next->t_readysince != 0) {
+		ss->ss_latency[schedstat_bucket(timer_now() -
+						next->t_readysince)]++;
+		next->t_readysince = 0;
+	}
+}
+
+/*
+ * A thread is being moved from cpu FROM to cpu TO.
+ */
+void
+schedstat_migrate(struct cpu *from, struct cpu *to)
+{
+	atomic_add((volatile int *)&from->c_schedstat.ss_migrated_out, 1);
+	atomic_add((volatile int *)&to->c_schedstat.ss_migrated_in, 1);
+}
+
+/*
+ * Sample the current cpu's run queue length.
+ */
+void
+schedstat_hardclock(void)
+{
+	struct cpu *c = curcpu->c_self;
+
+	if (!schedstat_enabled) {
+		return;
+	}
+	spinlock_acquire(&c->c_runqueue_lock);
+	c->c_schedstat.ss_rqlen[schedstat_bucket(c->c_runqueue.tl_count)]++;
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Print histogram H, skipping empty buckets at either end.
+ */
+static
+void
+schedstat_printhist(const char *title, const unsigned *h)
+{
+	unsigned first, last, i;
+
+	for (first = 0; first < SCHEDSTAT_BUCKETS; first++) {
+		if (h[first] != 0) {
+			break;
+		}
+	}
+	if (first == SCHEDSTAT_BUCKETS) {
+		kprintf("%s: no samples\n", title);
+		return;
+	}
+	for (last = SCHEDSTAT_BUCKETS - 1; h[last] == 0; last--) {
+		/* nothing */
+	}
+
+	kprintf("%s:\n", title);
+	for (i = first; i <= last; i++) {
+		if (i == 0) {
+			kprintf("  %10u            %10u\n", 0, h[i]);
+		}
+		else if (i == SCHEDSTAT_BUCKETS - 1) {
+			kprintf("  %10u -       ... %10u\n", 1U << (i - 1), h[i]);
+		}
+		else {
+			kprintf("  %10u - %10u %10u\n",
+				1U << (i - 1), (1U << i) - 1, h[i]);
+		}
+	}
+}
+
+void
+schedstat_dump(void)
+{
+	struct schedstat merged, *ss;
+	unsigned i, j, numcpus;
+
+	bzero(&merged, sizeof(merged));
+
+	/*
+	 * The other cpus keep updating their statistics while we read
+	 * them, so the totals may be slightly inconsistent.
+	 */
+	kprintf("%-4s %10s %10s %10s %10s\n", "cpu", "voluntary",
+		"preempted", "migr in", "migr out");
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		ss = &cpu_get(i)->c_schedstat;
+		kprintf("%-4u %10u %10u %10u %10u\n", i,
+			ss->ss_voluntary, ss->ss_involuntary,
+			ss->ss_migrated_in, ss->ss_migrated_out);
+		for (j = 0; j < SCHEDSTAT_BUCKETS; j++) {
+			merged.ss_latency[j] += ss->ss_latency[j];
+			merged.ss_rqlen[j] += ss->ss_rqlen[j];
+		}
+	}
+
+	schedstat_printhist("Run queue wait (ns)", merged.ss_latency);
+	schedstat_printhist("Run queue length", merged.ss_rqlen);
+}
+
+void
+schedstat_reset(void)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	numcpus = cpu_numcpus();
+	for (i = 0; i < numcpus; i++) {
+		c = cpu_get(i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		bzero(&c->c_schedstat, sizeof(c->c_schedstat));
+		spinlock_release(&c->c_runqueue_lock);
+	}
+}
+
+void
+schedstat_bootstrap(void)
+{
+	schedstat_enabled = true;
+}
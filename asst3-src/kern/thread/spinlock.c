@@ -30,6 +30,7 @@
 /* Make sure to build out-of-line versions of inline functions */
 #define SPINLOCK_INLINE   /* empty */
 #define MEMBAR_INLINE     /* empty */
+#define ATOMIC_INLINE     /* empty */
 
 #include <types.h>
 #include <lib.h>
@@ -37,7 +38,9 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <membar.h>
+#include <atomic.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -48,12 +51,22 @@
  * Initialize spinlock.
  */
 void
-spinlock_init(struct spinlock *splk)
+spinlock_init_kind(struct spinlock *splk, unsigned kind)
 {
+	KASSERT(kind == SPINLOCK_TAS || kind == SPINLOCK_TICKET);
+
 	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
+	splk->splk_kind = kind;
 	splk->splk_holder = NULL;
 }
 
+void
+spinlock_init(struct spinlock *splk)
+{
+	spinlock_init_kind(splk, SPINLOCK_DEFAULT);
+}
+
 /*
  * Clean up spinlock.
  */
@@ -61,7 +74,13 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	if (splk->splk_kind == SPINLOCK_TICKET) {
+		KASSERT(spinlock_data_get(&splk->splk_lock) ==
+			spinlock_data_get(&splk->splk_next));
+	}
+	else {
+		KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	}
 }
 
 /*
@@ -75,6 +94,9 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	uint64_t waitstart = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +112,56 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
+	if (splk->splk_kind == SPINLOCK_TICKET) {
+		spinlock_data_t ticket;
+
 		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
+		 * Take a ticket and wait for it to come up. Only the
+		 * holder writes splk_lock, so waiting is just reading.
 		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+		ticket = spinlock_data_fetchadd(&splk->splk_next, 1);
+		while (spinlock_data_get(&splk->splk_lock) != ticket) {
+#if OPT_LOCKSTAT
+			if (waitstart == 0) {
+				waitstart = lockstat_now();
+			}
+#endif
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+	}
+	else {
+		while (1) {
+			/*
+			 * Do test-test-and-set, that is, read first before
+			 * doing test-and-set, to reduce bus contention.
+			 *
+			 * Test-and-set is a machine-level atomic operation
+			 * that writes 1 into the lock word and returns the
+			 * previous value. If that value was 0, the lock was
+			 * previously unheld and we now own it. If it was 1,
+			 * we don't.
+			 */
+			if (spinlock_data_get(&splk->splk_lock) != 0) {
+#if OPT_LOCKSTAT
+				if (waitstart == 0) {
+					waitstart = lockstat_now();
+				}
+#endif
+				continue;
+			}
+			if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+				continue;
+			}
+			break;
 		}
-		break;
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	splk->splk_statpc = __builtin_return_address(0);
+	splk->splk_acquired = lockstat_acquired(LOCKSTAT_SPINLOCK, NULL,
+						splk->splk_statpc, waitstart);
+#endif
 }
 
 /*
@@ -127,9 +177,20 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(LOCKSTAT_SPINLOCK, NULL, splk->splk_statpc,
+			  splk->splk_acquired);
+#endif
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	if (splk->splk_kind == SPINLOCK_TICKET) {
+		/* Serve the next ticket. */
+		spinlock_data_set(&splk->splk_lock,
+				  spinlock_data_get(&splk->splk_lock) + 1);
+	}
+	else {
+		spinlock_data_set(&splk->splk_lock, 0);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,12 +33,15 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <timer.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -88,6 +91,10 @@ sem_destroy(struct semaphore *sem)
 void
 P(struct semaphore *sem)
 {
+#if OPT_LOCKSTAT
+	uint64_t waitstart = 0;
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -113,10 +120,18 @@ P(struct semaphore *sem)
 		 * Exercise: how would you implement strict FIFO
 		 * ordering?
 		 */
+#if OPT_LOCKSTAT
+		if (waitstart == 0) {
+			waitstart = lockstat_now();
+		}
+#endif
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+#if OPT_LOCKSTAT
+	lockstat_acquired(LOCKSTAT_SEM, sem->sem_name, NULL, waitstart);
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -137,6 +152,28 @@ V(struct semaphore *sem)
 ////////////////////////////////////////////////////////////
 //
 // Lock.
+//
+// Locks are adaptive: if the holder is running on another cpu it is
+// probably about to let go, so rather than paying for two context
+// switches a waiter spins until either the lock is released, the
+// holder stops running, or LOCK_SPIN_MAX iterations have gone by,
+// and only then goes to sleep.
+
+#define LOCK_SPIN_MAX	1000
+
+/*
+ * Check if HOLDER is on a cpu right now. HOLDER is read without any
+ * lock and may even have exited since we looked at lk_holder; that's
+ * harmless, since thread structures are only freed to the kernel heap
+ * (which stays mapped) and this is only a hint. The caller always
+ * rechecks lk_holder under lk_lock.
+ */
+static
+bool
+lock_holder_running(struct thread *holder)
+{
+	return ((volatile struct thread *)holder)->t_state == S_RUN;
+}
 
 struct lock *
 lock_create(const char *name)
@@ -162,6 +199,9 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lock->lk_acquired = 0;
+#endif
 
         return lock;
 }
@@ -182,17 +222,47 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread *holder;
+	unsigned spins;
+#if OPT_LOCKSTAT
+	uint64_t waitstart = 0;
+#endif
+
 	DEBUGASSERT(lock != NULL);
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&lock->lk_lock);
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
+	spins = 0;
+	while ((holder = lock->lk_holder) != NULL) {
+#if OPT_LOCKSTAT
+		if (waitstart == 0) {
+			waitstart = lockstat_now();
+		}
+#endif
+		if (spins < LOCK_SPIN_MAX && lock_holder_running(holder)) {
+			/*
+			 * The holder is running (necessarily on another
+			 * cpu). Spin without lk_lock so it can release.
+			 */
+			spinlock_release(&lock->lk_lock);
+			while (lock->lk_holder == holder &&
+			       spins < LOCK_SPIN_MAX &&
+			       lock_holder_running(holder)) {
+				spins++;
+			}
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
 		/* As in the semaphore. */
                 wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 
 	lock->lk_holder = curthread;
+#if OPT_LOCKSTAT
+	lock->lk_acquired = lockstat_acquired(LOCKSTAT_LOCK, lock->lk_name,
+					      NULL, waitstart);
+#endif
 	spinlock_release(&lock->lk_lock);
 }
 
@@ -203,6 +273,10 @@ lock_release(struct lock *lock)
 
 	spinlock_acquire(&lock->lk_lock);
 	KASSERT(lock->lk_holder == curthread);
+#if OPT_LOCKSTAT
+	lockstat_released(LOCKSTAT_LOCK, lock->lk_name, NULL,
+			  lock->lk_acquired);
+#endif
 	lock->lk_holder = NULL;
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 	spinlock_release(&lock->lk_lock);
@@ -269,6 +343,10 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+#if OPT_LOCKSTAT
+	uint64_t waitstart = lockstat_now();
+#endif
+
 	spinlock_acquire(&cv->cv_wchanlock);
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
@@ -280,10 +358,33 @@ cv_wait(struct cv *cv, struct lock *lock)
 	 * and separate out enough of the lock_acquire/lock_release
 	 * logic to make that work cleanly.
 	 */
+#if OPT_LOCKSTAT
+	lockstat_acquired(LOCKSTAT_CV, cv->cv_name, NULL, waitstart);
+#endif
 	spinlock_release(&cv->cv_wchanlock);
 	lock_acquire(lock);
 }
 
+int
+cv_wait_timeout(struct cv *cv, struct lock *lock, uint64_t nsecs)
+{
+	bool woken;
+#if OPT_LOCKSTAT
+	uint64_t waitstart = lockstat_now();
+#endif
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	woken = timer_wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock, nsecs);
+#if OPT_LOCKSTAT
+	lockstat_acquired(LOCKSTAT_CV, cv->cv_name, NULL, waitstart);
+#endif
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+
+	return woken ? 0 : ETIMEDOUT;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -301,3 +402,185 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writewaiters = 0;
+	rw->rw_writer = NULL;
+	rw->rw_upgrader = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_writewaiters == 0);
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	while (rw->rw_writer != NULL || rw->rw_writewaiters > 0 ||
+	       rw->rw_upgrader != NULL) {
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_upgrader != NULL && rw->rw_readers == 1) {
+		/* Only the upgrader is left; make sure it gets woken. */
+		wchan_wakeall(rw->rw_writewchan, &rw->rw_lock);
+	}
+	else if (rw->rw_readers == 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	rw->rw_writewaiters++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+	}
+	rw->rw_writewaiters--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_writewaiters > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+	else {
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_upgrade(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	if (rw->rw_upgrader != NULL) {
+		/* Two upgraders would wait for each other forever. */
+		spinlock_release(&rw->rw_lock);
+		return false;
+	}
+	rw->rw_upgrader = curthread;
+	while (rw->rw_readers > 1) {
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+	}
+	rw->rw_upgrader = NULL;
+	rw->rw_readers = 0;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+	return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	rw->rw_readers = 1;
+	if (rw->rw_writewaiters == 0) {
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = (rw->rw_writer == curthread);
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
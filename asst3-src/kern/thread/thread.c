@@ -53,11 +53,22 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <lockstat.h>
+#include <cpustat.h>
+#include <trace.h>
+#include <prof.h>
+#include <schedstat.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Maximum number of exited threads (with their stacks) each cpu
+ * keeps around for reuse by thread_fork.
+ */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +83,8 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+static void thread_idlemain(void *data1, unsigned long data2);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,6 +124,39 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Set up the fields of a new or recycled thread. Everything except
+ * the name and the stack is (re)initialized here.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_affinity = CPUMASK_ALL;
+	thread->t_proc = NULL;
+#if OPT_SCHEDSTAT
+	thread->t_readysince = 0;
+#endif
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* Public fields */
+	thread->t_tid = 0;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,23 +179,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_initfields(thread);
 
 	return thread;
 }
@@ -168,6 +199,7 @@ cpu_create(unsigned hardware_number)
 	struct cpu *c;
 	int result;
 	char namebuf[16];
+	unsigned i;
 
 	c = kmalloc(sizeof(*c));
 	if (c == NULL) {
@@ -178,13 +210,45 @@ cpu_create(unsigned hardware_number)
 	c->c_hardware_number = hardware_number;
 
 	c->c_curthread = NULL;
+	c->c_handoff = NULL;
+	c->c_idlethread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+#if OPT_LOCKSTAT
+	c->c_lockstat = lockstat_table_create();
+	if (c->c_lockstat == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
+#endif
+#if OPT_TRACE
+	c->c_trace = trace_ring_create();
+	if (c->c_trace == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
+#endif
+#if OPT_PROF
+	c->c_prof = prof_table_create();
+	if (c->c_prof == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
+	c->c_intrpc = 0;
+	c->c_intruser = false;
+#endif
+	for (i=0; i<NCPUSTATS; i++) {
+		c->c_stats[i] = 0;
+	}
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
-	spinlock_init(&c->c_runqueue_lock);
+	/* Contended by every cpu that wakes or migrates threads here. */
+	spinlock_init_kind(&c->c_runqueue_lock, SPINLOCK_TICKET);
+
+	c->c_timers = NULL;
+	c->c_timer_running = NULL;
+	c->c_nexthardclock = 0;
+	spinlock_init(&c->c_timers_lock);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -194,6 +258,8 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	/* Affinity masks have one bit per cpu. */
+	KASSERT(c->c_number < CPUMASK_BITS);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -247,6 +313,31 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
 	}
 
+	/*
+	 * The idle thread is never on a run queue; thread_switch runs
+	 * it only to get off the stack of a thread that is leaving
+	 * for another cpu. See thread_idlemain.
+	 */
+	snprintf(namebuf, sizeof(namebuf), "<idle #%d>", c->c_number);
+	c->c_idlethread = thread_create(namebuf);
+	if (c->c_idlethread == NULL) {
+		panic("cpu_create: thread_create failed\n");
+	}
+	c->c_idlethread->t_stack = kmalloc(STACK_SIZE);
+	if (c->c_idlethread->t_stack == NULL) {
+		panic("cpu_create: couldn't allocate stack");
+	}
+	thread_checkstack_init(c->c_idlethread);
+	c->c_idlethread->t_cpu = c;
+	c->c_idlethread->t_affinity = CPUMASK_CPU(c->c_number);
+	result = proc_addthread(kproc, c->c_idlethread);
+	if (result) {
+		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
+	}
+	/* As in thread_fork. */
+	c->c_idlethread->t_iplhigh_count++;
+	switchframe_init(c->c_idlethread, thread_idlemain, NULL, 0);
+
 	cpu_machdep_init(c);
 
 	return c;
@@ -302,8 +393,56 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadcache.tl_count < THREAD_CACHE_MAX) {
+			/* Don't recycle a stack that was overrun. */
+			thread_checkstack(z);
+			threadlist_addhead(&curcpu->c_threadcache, z);
+		}
+		else {
+			thread_destroy(z);
+		}
+	}
+}
+
+/*
+ * Get a thread (with its stack) from this cpu's cache of exited
+ * threads and set it up to be forked under the name NAME. Returns
+ * NULL if the cache is empty or we can't allocate the name.
+ */
+static
+struct thread *
+thread_recycle(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	/* The cache is per-cpu; don't get moved while we look at it. */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
 	}
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+
+	newname = kstrdup(name);
+	if (newname == NULL) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	kfree(thread->t_name);
+	thread->t_name = newname;
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread_initfields(thread);
+	thread_checkstack_init(thread);
+
+	return thread;
 }
 
 /*
@@ -420,6 +559,21 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+/*
+ * Count and look up cpus.
+ */
+unsigned
+cpu_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned num)
+{
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -442,10 +596,50 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Check if thread T's affinity mask allows it to run on cpu C.
+ */
+static
+bool
+thread_canrun(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & CPUMASK_CPU(c->c_number)) != 0;
+}
+
+/*
+ * Choose a cpu for thread T among those its affinity mask allows: the
+ * one with the shortest run queue. The counts are read without
+ * locking, so this is only a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(struct thread *t)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus;
+
+	best = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!thread_canrun(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too.
+ * targetcpu might be curcpu; it might not be, too. If the target
+ * thread's affinity no longer allows its cpu, it is moved to one that
+ * is allowed; in that case the caller must not already hold the lock.
  */
 static
 void
@@ -453,9 +647,14 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
 
-	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
+	if (!thread_canrun(target, targetcpu)) {
+		KASSERT(!already_have_lock);
+		targetcpu = thread_pickcpu(target);
+		target->t_cpu = targetcpu;
+	}
 
+	/* Lock the run queue of the target thread's cpu. */
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -467,6 +666,9 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
 	threadlist_addtail(&targetcpu->c_runqueue, target);
+#if OPT_SCHEDSTAT
+	schedstat_enqueue(target);
+#endif
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -481,6 +683,24 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Requeue the thread that thread_switch left in c_handoff because it
+ * had to move to another cpu. Called by the thread that runs after it,
+ * once its context has been saved.
+ */
+static
+void
+thread_handoff(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_handoff;
+	if (t != NULL) {
+		curcpu->c_handoff = NULL;
+		thread_make_runnable(t, false);
+	}
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -500,18 +720,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse an exited thread and its stack if we have one */
+	newthread = thread_recycle(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -519,6 +743,7 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = curthread->t_affinity;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -587,8 +812,13 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. (Except
+	 * in the idle thread, which should go idle instead.)
+	 */
+	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue) &&
+	    thread_canrun(cur, curcpu->c_self) &&
+	    cur != curcpu->c_idlethread) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -599,7 +829,24 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (cur == curcpu->c_idlethread) {
+			/* Never queued; see thread_idlemain. */
+		}
+		else if (thread_canrun(cur, curcpu->c_self)) {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
+		else {
+			/*
+			 * Our affinity no longer allows this cpu. We
+			 * can't go on another cpu's run queue until
+			 * our context is saved, or that cpu might run
+			 * us while we're still running here; so leave
+			 * it to whoever runs next (the idle thread
+			 * if nobody else). See thread_handoff.
+			 */
+			KASSERT(curcpu->c_handoff == NULL);
+			curcpu->c_handoff = cur;
+		}
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
@@ -636,12 +883,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * If we're leaving for another cpu, we can't idle on our own
+	 * stack: nothing would requeue us until something else ran
+	 * here. Switch to the idle thread instead, which hands us off
+	 * and then idles on its stack.
 	 */
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
+		if (next == NULL && curcpu->c_handoff != NULL) {
+			KASSERT(cur != curcpu->c_idlethread);
+			next = curcpu->c_idlethread;
+		}
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
 			cpu_idle();
@@ -660,6 +916,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	curcpu->c_curthread = next;
 	curthread = next;
 
+#if OPT_SCHEDSTAT
+	/* Being put back on the run queue from an interrupt is preemption. */
+	schedstat_switch(cur, next, newstate == S_READY && cur->t_in_interrupt);
+#endif
+
+	if (next != cur) {
+		cpustat_inc(CPUSTAT_SWITCHES);
+		TRACE(TRACE_SWITCH, cur, next);
+	}
+
 	/* do the switch (in assembler in switch.S) */
 	switchframe_switch(&cur->t_context, &next->t_context);
 
@@ -717,6 +983,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Pass on the previous thread, if it has to change cpus. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -750,6 +1019,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Pass on the previous thread, if it has to change cpus. */
+	thread_handoff();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -766,6 +1038,22 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	thread_exit();
 }
 
+/*
+ * Body of each cpu's idle thread. thread_switch never queues it, so
+ * each time around it goes idle until something else is runnable.
+ */
+static
+void
+thread_idlemain(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		thread_switch(S_READY, NULL, NULL);
+	}
+}
+
 /*
  * Cause the current thread to exit.
  *
@@ -919,8 +1207,22 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Likewise skip threads whose affinity doesn't
+			 * allow this cpu; they also go back on our own
+			 * run queue.
+			 */
+			if (!thread_canrun(t, c)) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
+
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
+#if OPT_SCHEDSTAT
+			schedstat_migrate(curcpu->c_self, c);
+#endif
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -953,6 +1255,42 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Set thread T's cpu affinity. See thread.h.
+ */
+int
+thread_setaffinity(struct thread *t, unsigned mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < CPUMASK_BITS) {
+		mask &= CPUMASK_CPU(numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	t->t_affinity = mask;
+	if (t == curthread && !thread_canrun(t, curcpu->c_self)) {
+		/* thread_switch sends us elsewhere. */
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * Pin the current thread to cpu CPUNUM.
+ */
+int
+thread_pin(unsigned cpunum)
+{
+	if (cpunum >= CPUMASK_BITS) {
+		return EINVAL;
+	}
+	return thread_setaffinity(curthread, CPUMASK_CPU(cpunum));
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1012,6 +1350,7 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+	TRACE(TRACE_SLEEP, wc, curthread);
 	thread_switch(S_SLEEP, wc, lk);
 	spinlock_acquire(lk);
 }
@@ -1042,6 +1381,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	TRACE(TRACE_WAKE, wc, target);
 	thread_make_runnable(target, false);
 }
 
@@ -1072,12 +1412,35 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		TRACE(TRACE_WAKE, wc, target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up a particular thread, if it's sleeping on the wait channel.
+ * Returns true if it was.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *t)
+{
+	struct thread *target;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	THREADLIST_FORALL(target, wc->wc_threads) {
+		if (target == t) {
+			threadlist_remove(&wc->wc_threads, t);
+			TRACE(TRACE_WAKE, wc, t);
+			thread_make_runnable(t, false);
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
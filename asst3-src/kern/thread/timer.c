@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * High-resolution timers.
+ *
+ * Each cpu keeps its pending timers in a pairing heap rooted at
+ * c_timers. A pairing heap needs no storage beyond the links in each
+ * timer, so starting a timer never allocates memory and can be done
+ * from interrupt handlers; insert is O(1) and removing the earliest
+ * (or any) timer is amortized O(log n).
+ *
+ * The cpu's on-chip timer is programmed for the earlier of the first
+ * pending timer and the next hardclock, so hardclock() still happens
+ * HZ times a second and timers fire as close to their deadlines as
+ * the hardware allows.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <timer.h>
+#include <thread.h>
+#include <current.h>
+#include <mainbus.h>
+
+/* nanoseconds between hardclocks */
+#define NSECS_PER_HARDCLOCK	(NSECS_PER_SEC / HZ)
+
+/*
+ * Shortest interval we'll program into the hardware, to avoid
+ * interrupt storms. Also the slack allowed on hardclock deadlines.
+ */
+#define TIMER_MINNSECS		10000	/* 10 us */
+
+/*
+ * Set once the clock is attached and timer_now() works; until then
+ * timer_interrupt() just runs hardclock at HZ.
+ */
+static bool timer_clockok;
+
+/*
+ * Wait channel for timer_sleep(). Nobody ever wakes it; sleepers are
+ * woken individually by their timers.
+ */
+static struct wchan *timer_sleepchan;
+static struct spinlock timer_sleeplock;
+
+////////////////////////////////////////////////////////////
+//
+// Pairing heap
+//
+// In the heap each timer's tm_child points at its leftmost child,
+// tm_sibling at its next sibling to the right, and tm_prev at its
+// left sibling or (for a leftmost child) its parent. The root has no
+// siblings and tm_prev == NULL.
+
+/*
+ * Combine two heaps (either may be empty), returning the new root.
+ * The roots passed in must have no siblings.
+ */
+static
+struct timer *
+timerheap_meld(struct timer *a, struct timer *b)
+{
+	struct timer *tmp;
+
+	if (a == NULL) {
+		return b;
+	}
+	if (b == NULL) {
+		return a;
+	}
+	if (b->tm_deadline < a->tm_deadline) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	/* B becomes the leftmost child of A */
+	b->tm_prev = a;
+	b->tm_sibling = a->tm_child;
+	if (a->tm_child != NULL) {
+		a->tm_child->tm_prev = b;
+	}
+	a->tm_child = b;
+	return a;
+}
+
+/*
+ * Combine a list of sibling heaps into one heap with the standard
+ * two-pass method: meld pairs left to right, then meld the results
+ * right to left.
+ */
+static
+struct timer *
+timerheap_mergepairs(struct timer *first)
+{
+	struct timer *a, *b, *next, *pairs, *result;
+
+	pairs = NULL;
+	while (first != NULL) {
+		a = first;
+		b = a->tm_sibling;
+		next = (b != NULL) ? b->tm_sibling : NULL;
+
+		a->tm_sibling = a->tm_prev = NULL;
+		if (b != NULL) {
+			b->tm_sibling = b->tm_prev = NULL;
+		}
+		a = timerheap_meld(a, b);
+
+		/* push onto the list of melded pairs (reversed) */
+		a->tm_sibling = pairs;
+		pairs = a;
+
+		first = next;
+	}
+
+	result = NULL;
+	while (pairs != NULL) {
+		next = pairs->tm_sibling;
+		pairs->tm_sibling = NULL;
+		result = timerheap_meld(result, pairs);
+		pairs = next;
+	}
+	return result;
+}
+
+/*
+ * Add T to the heap of cpu C. Returns true if it became the first
+ * timer to expire.
+ */
+static
+bool
+timerheap_insert(struct cpu *c, struct timer *t)
+{
+	KASSERT(spinlock_do_i_hold(&c->c_timers_lock));
+	KASSERT(t->tm_child == NULL);
+
+	t->tm_sibling = t->tm_prev = NULL;
+	c->c_timers = timerheap_meld(c->c_timers, t);
+	return c->c_timers == t;
+}
+
+/*
+ * Remove T, which must be on the heap of cpu C.
+ */
+static
+void
+timerheap_remove(struct cpu *c, struct timer *t)
+{
+	struct timer *sub;
+
+	KASSERT(spinlock_do_i_hold(&c->c_timers_lock));
+
+	if (c->c_timers == t) {
+		c->c_timers = timerheap_mergepairs(t->tm_child);
+	}
+	else {
+		/* Cut T (and its subtree) out of its parent's child list */
+		if (t->tm_prev->tm_child == t) {
+			t->tm_prev->tm_child = t->tm_sibling;
+		}
+		else {
+			t->tm_prev->tm_sibling = t->tm_sibling;
+		}
+		if (t->tm_sibling != NULL) {
+			t->tm_sibling->tm_prev = t->tm_prev;
+		}
+		sub = timerheap_mergepairs(t->tm_child);
+		c->c_timers = timerheap_meld(c->c_timers, sub);
+	}
+	t->tm_child = t->tm_sibling = t->tm_prev = NULL;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timers
+
+/*
+ * Current time in nanoseconds.
+ */
+uint64_t
+timer_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Work out how long from NOW cpu C should next be interrupted.
+ */
+static
+uint32_t
+timer_delay(struct cpu *c, uint64_t now)
+{
+	uint64_t next;
+
+	KASSERT(spinlock_do_i_hold(&c->c_timers_lock));
+
+	next = c->c_nexthardclock;
+	if (c->c_timers != NULL && c->c_timers->tm_deadline < next) {
+		next = c->c_timers->tm_deadline;
+	}
+	if (next <= now + TIMER_MINNSECS) {
+		return TIMER_MINNSECS;
+	}
+	if (next - now > NSECS_PER_HARDCLOCK) {
+		return NSECS_PER_HARDCLOCK;
+	}
+	return next - now;
+}
+
+void
+timer_init(struct timer *t, timer_func func, void *data)
+{
+	t->tm_deadline = 0;
+	t->tm_func = func;
+	t->tm_data = data;
+	t->tm_cpu = NULL;
+	t->tm_queued = false;
+	t->tm_child = t->tm_sibling = t->tm_prev = NULL;
+}
+
+void
+timer_start_abs(struct timer *t, uint64_t deadline)
+{
+	struct cpu *c;
+	uint64_t now;
+	int spl;
+
+	KASSERT(timer_clockok);
+
+	/* Stay on this cpu while we look at it. */
+	spl = splhigh();
+	c = curcpu->c_self;
+
+	/* Must not be pending, except when restarted by its own function. */
+	KASSERT(t->tm_cpu == NULL || t->tm_cpu == c);
+	KASSERT(!t->tm_queued);
+
+	now = timer_now();
+
+	spinlock_acquire(&c->c_timers_lock);
+	t->tm_deadline = deadline;
+	t->tm_cpu = c;
+	t->tm_queued = true;
+	if (timerheap_insert(c, t) && c->c_timer_running == NULL) {
+		/*
+		 * New first deadline; reprogram the hardware. (If we're
+		 * being called from a timer function, timer_interrupt
+		 * will do it on the way out.)
+		 */
+		if (c->c_nexthardclock == 0) {
+			c->c_nexthardclock = now + NSECS_PER_HARDCLOCK;
+		}
+		mainbus_settimer(timer_delay(c, now));
+	}
+	spinlock_release(&c->c_timers_lock);
+
+	splx(spl);
+}
+
+void
+timer_start(struct timer *t, uint64_t nsecs)
+{
+	timer_start_abs(t, timer_now() + nsecs);
+}
+
+bool
+timer_cancel(struct timer *t)
+{
+	struct cpu *c;
+	bool ret = false;
+
+	while ((c = t->tm_cpu) != NULL) {
+		spinlock_acquire(&c->c_timers_lock);
+		if (t->tm_cpu == c) {
+			if (t->tm_queued) {
+				timerheap_remove(c, t);
+				t->tm_queued = false;
+				ret = true;
+			}
+			if (c->c_timer_running != t) {
+				t->tm_cpu = NULL;
+				spinlock_release(&c->c_timers_lock);
+				break;
+			}
+			/* Its function is running; spin until it's done. */
+			KASSERT(c != curcpu->c_self);
+		}
+		spinlock_release(&c->c_timers_lock);
+	}
+	return ret;
+}
+
+bool
+timer_interrupt(uint32_t *nsecs)
+{
+	struct cpu *c;
+	struct timer *t;
+	uint64_t now;
+	bool tick;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!timer_clockok) {
+		*nsecs = NSECS_PER_HARDCLOCK;
+		return true;
+	}
+
+	c = curcpu->c_self;
+	now = timer_now();
+
+	spinlock_acquire(&c->c_timers_lock);
+	while ((t = c->c_timers) != NULL && t->tm_deadline <= now) {
+		timerheap_remove(c, t);
+		t->tm_queued = false;
+		c->c_timer_running = t;
+		spinlock_release(&c->c_timers_lock);
+
+		t->tm_func(t->tm_data);
+
+		spinlock_acquire(&c->c_timers_lock);
+		c->c_timer_running = NULL;
+		if (!t->tm_queued) {
+			/* not restarted; T may be freed once we unlock */
+			t->tm_cpu = NULL;
+		}
+		now = timer_now();
+	}
+
+	if (c->c_nexthardclock == 0) {
+		c->c_nexthardclock = now;
+	}
+	tick = c->c_nexthardclock <= now + TIMER_MINNSECS;
+	if (tick) {
+		c->c_nexthardclock += NSECS_PER_HARDCLOCK;
+		if (c->c_nexthardclock <= now) {
+			/* We fell behind; don't try to catch up. */
+			c->c_nexthardclock = now + NSECS_PER_HARDCLOCK;
+		}
+	}
+	*nsecs = timer_delay(c, now);
+	spinlock_release(&c->c_timers_lock);
+
+	return tick;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timed sleeps
+
+struct timer_sleeper {
+	struct wchan *ts_wchan;
+	struct spinlock *ts_lock;
+	struct thread *ts_thread;
+	bool ts_expired;
+};
+
+/*
+ * Timer function for timer_wchan_sleep: wake the sleeper if it's
+ * still asleep.
+ */
+static
+void
+timer_wakeup(void *data)
+{
+	struct timer_sleeper *ts = data;
+
+	spinlock_acquire(ts->ts_lock);
+	ts->ts_expired = wchan_wakethread(ts->ts_wchan, ts->ts_lock,
+					  ts->ts_thread);
+	spinlock_release(ts->ts_lock);
+}
+
+bool
+timer_wchan_sleep(struct wchan *wc, struct spinlock *lk, uint64_t nsecs)
+{
+	struct timer_sleeper ts;
+	struct timer t;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	ts.ts_wchan = wc;
+	ts.ts_lock = lk;
+	ts.ts_thread = curthread;
+	ts.ts_expired = false;
+
+	/*
+	 * Holding LK keeps the timer from waking us before we're on
+	 * the wait channel.
+	 */
+	timer_init(&t, timer_wakeup, &ts);
+	timer_start(&t, nsecs);
+	wchan_sleep(wc, lk);
+
+	/*
+	 * The timer function needs LK, so we can't wait for it while
+	 * holding LK.
+	 */
+	spinlock_release(lk);
+	timer_cancel(&t);
+	spinlock_acquire(lk);
+
+	return !ts.ts_expired;
+}
+
+void
+timer_sleep(uint64_t nsecs)
+{
+	uint64_t now, deadline;
+
+	deadline = timer_now() + nsecs;
+
+	spinlock_acquire(&timer_sleeplock);
+	while ((now = timer_now()) < deadline) {
+		timer_wchan_sleep(timer_sleepchan, &timer_sleeplock,
+				  deadline - now);
+	}
+	spinlock_release(&timer_sleeplock);
+}
+
+/*
+ * Setup. Must be called after the clock device has been attached.
+ */
+void
+timer_bootstrap(void)
+{
+	spinlock_init(&timer_sleeplock);
+	timer_sleepchan = wchan_create("timer");
+	if (timer_sleepchan == NULL) {
+		panic("Couldn't create timer wait channel\n");
+	}
+	timer_clockok = true;
+}
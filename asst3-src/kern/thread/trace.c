@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Kernel tracepoints. See trace.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <atomic.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <timer.h>
+#include <trace.h>
+
+/* Records per cpu; a power of two, chosen so a ring fits in one page. */
+#define TRACE_RINGSIZE		128
+
+struct trace_entry {
+	uint64_t te_time;		/* per timer_now() */
+	uint32_t te_event;		/* TRACE_* */
+	uint32_t te_a, te_b;		/* event-specific */
+};
+
+struct trace_ring {
+	/*
+	 * Number of records ever claimed; the next one goes in slot
+	 * tr_head % TRACE_RINGSIZE. Updated with atomic_add.
+	 */
+	volatile unsigned tr_head;
+	unsigned tr_tail;		/* first record not yet drained */
+	struct trace_entry tr_entries[TRACE_RINGSIZE];
+};
+
+static const char *const trace_names[NTRACEEVENTS] = {
+	"switch",
+	"vmfault",
+	"syscall",
+	"sysret",
+	"diskstart",
+	"diskdone",
+	"sleep",
+	"wake",
+};
+
+/* Whether to record. */
+static volatile bool trace_enabled;
+
+struct trace_ring *
+trace_ring_create(void)
+{
+	struct trace_ring *tr;
+
+	COMPILE_ASSERT(sizeof(struct trace_ring) <= PAGE_SIZE);
+	COMPILE_ASSERT((TRACE_RINGSIZE & (TRACE_RINGSIZE - 1)) == 0);
+
+	tr = kmalloc(sizeof(*tr));
+	if (tr == NULL) {
+		return NULL;
+	}
+	bzero(tr, sizeof(*tr));
+	return tr;
+}
+
+void
+trace_record(unsigned ev, uint32_t a, uint32_t b)
+{
+	struct trace_ring *tr;
+	struct trace_entry *te;
+	unsigned slot;
+
+	KASSERT(ev < NTRACEEVENTS);
+
+	if (!trace_enabled || !CURCPU_EXISTS()) {
+		return;
+	}
+
+	/*
+	 * Claim a slot. If we get interrupted or migrated after this
+	 * the record still goes in the ring we claimed it from, and
+	 * an interrupt handler that traces gets the next slot.
+	 */
+	tr = curcpu->c_trace;
+	slot = atomic_add((volatile int *)&tr->tr_head, 1) - 1;
+	te = &tr->tr_entries[slot % TRACE_RINGSIZE];
+
+	te->te_time = timer_now();
+	te->te_event = ev;
+	te->te_a = a;
+	te->te_b = b;
+}
+
+void
+trace_enable(bool on)
+{
+	trace_enabled = on;
+	membar_any_any();
+}
+
+/*
+ * Pick the oldest record in cpu C's ring, if any is left, moving the
+ * ring's tail past records that have since been overwritten.
+ */
+static
+struct trace_entry *
+trace_oldest(struct cpu *c)
+{
+	struct trace_ring *tr = c->c_trace;
+
+	if (tr->tr_head - tr->tr_tail > TRACE_RINGSIZE) {
+		tr->tr_tail = tr->tr_head - TRACE_RINGSIZE;
+	}
+	if (tr->tr_tail == tr->tr_head) {
+		return NULL;
+	}
+	return &tr->tr_entries[tr->tr_tail % TRACE_RINGSIZE];
+}
+
+/*
+ * Print the buffered records of all cpus merged in time order. Turn
+ * recording off while doing it, so the rings hold still; a record
+ * that was being written as we started may come out garbled.
+ */
+void
+trace_drain(void)
+{
+	unsigned i, num, best;
+	struct trace_entry *te, *bestte;
+	uint64_t first, prev;
+	bool wasenabled;
+
+	wasenabled = trace_enabled;
+	trace_enable(false);
+
+	num = cpu_numcpus();
+	first = prev = 0;
+	while (1) {
+		best = 0;
+		bestte = NULL;
+		for (i=0; i<num; i++) {
+			te = trace_oldest(cpu_get(i));
+			if (te != NULL &&
+			    (bestte == NULL || te->te_time < bestte->te_time)) {
+				best = i;
+				bestte = te;
+			}
+		}
+		if (bestte == NULL) {
+			break;
+		}
+		if (first == 0) {
+			first = prev = bestte->te_time;
+			kprintf("%12s %8s %-4s %-10s %-10s %s\n",
+				"time (ns)", "delta", "cpu", "event",
+				"a", "b");
+		}
+		kprintf("%12llu %8llu %-4u %-10s 0x%08x 0x%08x\n",
+			(unsigned long long)(bestte->te_time - first),
+			(unsigned long long)(bestte->te_time - prev),
+			best,
+			bestte->te_event < NTRACEEVENTS ?
+				trace_names[bestte->te_event] : "?",
+			bestte->te_a, bestte->te_b);
+		prev = bestte->te_time;
+		cpu_get(best)->c_trace->tr_tail++;
+	}
+	if (first == 0) {
+		kprintf("trace: no records\n");
+	}
+
+	trace_enable(wasenabled);
+}
+
+void
+trace_clear(void)
+{
+	unsigned i, num;
+	struct trace_ring *tr;
+	bool wasenabled;
+
+	wasenabled = trace_enabled;
+	trace_enable(false);
+
+	num = cpu_numcpus();
+	for (i=0; i<num; i++) {
+		tr = cpu_get(i)->c_trace;
+		tr->tr_tail = tr->tr_head;
+	}
+
+	trace_enable(wasenabled);
+}
@@ -42,6 +42,7 @@
 #include <synch.h>
 #include <vnode.h>
 #include <device.h>
+#include <poll.h>
 
 /*
  * Called for each open().
@@ -150,6 +151,23 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll() and select(). Pass through if the device can
+ * block; otherwise it's always ready. (dev_poll is taken by the
+ * async request code.)
+ */
+static
+int
+dev_pollready(struct vnode *v, int events, struct pollset *ps)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return events & POLL_ALWAYS;
+	}
+	return d->d_ops->devop_poll(d, events, ps);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -339,6 +357,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
 	.vop_namefile = dev_namefile,
+	.vop_poll = dev_pollready,
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
 	.vop_mkdir = vopfail_mkdir_notdir,
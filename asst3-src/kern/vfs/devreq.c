@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Asynchronous block I/O requests (see device.h).
+ *
+ * Completion is signalled through a single wait channel shared by all
+ * requests; waiters recheck their own request when woken.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <device.h>
+
+static struct spinlock devreq_lock = SPINLOCK_INITIALIZER;
+static struct wchan *devreq_wchan;
+
+/*
+ * Set up at boot.
+ */
+void
+devreq_bootstrap(void)
+{
+	devreq_wchan = wchan_create("devreq");
+	if (devreq_wchan == NULL) {
+		panic("devreq_bootstrap: Out of memory\n");
+	}
+}
+
+/*
+ * Mark a request finished. Called by drivers, possibly in an
+ * interrupt handler.
+ */
+void
+devreq_complete(struct devreq *r, int result)
+{
+	KASSERT(!r->dr_complete);
+
+	r->dr_result = result;
+	if (r->dr_done != NULL) {
+		r->dr_done(r, result);
+	}
+
+	spinlock_acquire(&devreq_lock);
+	r->dr_complete = true;
+	wchan_wakeall(devreq_wchan, &devreq_lock);
+	spinlock_release(&devreq_lock);
+}
+
+/*
+ * Start a request.
+ */
+int
+dev_submit(struct device *d, struct devreq *r)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(r->dr_nblocks > 0);
+
+	r->dr_result = 0;
+	r->dr_complete = false;
+
+	if (d->d_ops->devop_submit != NULL) {
+		return d->d_ops->devop_submit(d, r);
+	}
+
+	/* No native support; do it now. */
+	uio_kinit(&iov, &ku, r->dr_data, r->dr_nblocks * d->d_blocksize,
+		  ((off_t)r->dr_block) * d->d_blocksize,
+		  r->dr_write ? UIO_WRITE : UIO_READ);
+	result = DEVOP_IO(d, &ku);
+	devreq_complete(r, result);
+	return 0;
+}
+
+/*
+ * Check if a request has finished.
+ */
+bool
+dev_poll(struct devreq *r)
+{
+	bool ret;
+
+	spinlock_acquire(&devreq_lock);
+	ret = r->dr_complete;
+	spinlock_release(&devreq_lock);
+	return ret;
+}
+
+/*
+ * Wait for a request to finish and return its result.
+ */
+int
+dev_wait(struct devreq *r)
+{
+	spinlock_acquire(&devreq_lock);
+	while (!r->dr_complete) {
+		wchan_sleep(devreq_wchan, &devreq_lock);
+	}
+	spinlock_release(&devreq_lock);
+	return r->dr_result;
+}
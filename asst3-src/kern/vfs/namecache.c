@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Directory name lookup cache (see namecache.h).
+ *
+ * The entries are a fixed table. Each one in use is on a hash chain
+ * by (directory, name); all of them are on an LRU list, most recently
+ * used first, with unused entries kept at the tail so they get
+ * reused before anything is evicted. Everything is covered by one
+ * spinlock; nothing done under it takes long or sleeps.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <cpustat.h>
+#include <vnode.h>
+#include <namecache.h>
+
+#define NC_NENTRIES	256	/* cache size */
+#define NC_NHASH	64	/* hash chains; must be a power of two */
+
+struct ncentry {
+	struct vnode *nc_dir;		/* directory; NULL if unused */
+	uint32_t nc_ino;		/* file number, if not negative */
+	bool nc_negative;		/* name doesn't exist */
+	char nc_name[NC_NAMELEN];	/* name */
+	struct ncentry *nc_hnext;	/* hash chain */
+	struct ncentry *nc_lrunext;	/* LRU list */
+	struct ncentry *nc_lruprev;
+};
+
+static struct spinlock nc_lock = SPINLOCK_INITIALIZER;
+static struct ncentry nc_entries[NC_NENTRIES];
+static struct ncentry *nc_hash[NC_NHASH];
+static struct ncentry nc_lru;		/* list head; next is newest */
+static unsigned nc_inuse;		/* entries with nc_dir set */
+
+////////////////////////////////////////////////////////////
+// Internal
+
+static
+unsigned
+nc_hashfn(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (uintptr_t)dir >> 4;
+	while (*name) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+	return h & (NC_NHASH - 1);
+}
+
+static
+void
+nc_lru_unlink(struct ncentry *nc)
+{
+	nc->nc_lruprev->nc_lrunext = nc->nc_lrunext;
+	nc->nc_lrunext->nc_lruprev = nc->nc_lruprev;
+}
+
+/* Make NC the most recently used. */
+static
+void
+nc_lru_head(struct ncentry *nc)
+{
+	nc_lru_unlink(nc);
+	nc->nc_lrunext = nc_lru.nc_lrunext;
+	nc->nc_lruprev = &nc_lru;
+	nc_lru.nc_lrunext->nc_lruprev = nc;
+	nc_lru.nc_lrunext = nc;
+}
+
+/* Make NC the next to be reused. */
+static
+void
+nc_lru_tail(struct ncentry *nc)
+{
+	nc_lru_unlink(nc);
+	nc->nc_lruprev = nc_lru.nc_lruprev;
+	nc->nc_lrunext = &nc_lru;
+	nc_lru.nc_lruprev->nc_lrunext = nc;
+	nc_lru.nc_lruprev = nc;
+}
+
+/*
+ * Find the entry for DIR and NAME, if any. Also hands back the
+ * pointer that points to it, for unhashing.
+ */
+static
+struct ncentry *
+nc_find(struct vnode *dir, const char *name, struct ncentry ***prevp)
+{
+	struct ncentry **ncp, *nc;
+
+	for (ncp = &nc_hash[nc_hashfn(dir, name)]; *ncp != NULL;
+	     ncp = &(*ncp)->nc_hnext) {
+		nc = *ncp;
+		if (nc->nc_dir == dir && !strcmp(nc->nc_name, name)) {
+			if (prevp != NULL) {
+				*prevp = ncp;
+			}
+			return nc;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take an entry off its hash chain and put it at the tail of the LRU
+ * list for reuse.
+ */
+static
+void
+nc_free(struct ncentry *nc, struct ncentry **prevp)
+{
+	KASSERT(*prevp == nc);
+	*prevp = nc->nc_hnext;
+	nc->nc_hnext = NULL;
+	nc->nc_dir = NULL;
+	nc_lru_tail(nc);
+	nc_inuse--;
+}
+
+/*
+ * Common code for namecache_enter and namecache_enter_negative.
+ */
+static
+void
+nc_enter(struct vnode *dir, const char *name, bool negative, uint32_t ino)
+{
+	struct ncentry *nc, **prevp;
+	unsigned h;
+
+	if (strlen(name) >= NC_NAMELEN) {
+		return;
+	}
+
+	spinlock_acquire(&nc_lock);
+
+	nc = nc_find(dir, name, NULL);
+	if (nc == NULL) {
+		/* Recycle the least recently used entry. */
+		nc = nc_lru.nc_lruprev;
+		if (nc->nc_dir != NULL) {
+			nc_find(nc->nc_dir, nc->nc_name, &prevp);
+			nc_free(nc, prevp);
+		}
+		h = nc_hashfn(dir, name);
+		nc->nc_dir = dir;
+		strcpy(nc->nc_name, name);
+		nc->nc_hnext = nc_hash[h];
+		nc_hash[h] = nc;
+		nc_inuse++;
+	}
+	nc->nc_negative = negative;
+	nc->nc_ino = ino;
+	nc_lru_head(nc);
+
+	spinlock_release(&nc_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Interface
+
+/*
+ * Set up at boot: all entries unused, on the LRU list.
+ */
+void
+namecache_bootstrap(void)
+{
+	unsigned i;
+
+	nc_lru.nc_lrunext = nc_lru.nc_lruprev = &nc_lru;
+	for (i=0; i<NC_NENTRIES; i++) {
+		nc_entries[i].nc_dir = NULL;
+		nc_entries[i].nc_hnext = NULL;
+		nc_entries[i].nc_lrunext = &nc_lru;
+		nc_entries[i].nc_lruprev = nc_lru.nc_lruprev;
+		nc_lru.nc_lruprev->nc_lrunext = &nc_entries[i];
+		nc_lru.nc_lruprev = &nc_entries[i];
+	}
+	for (i=0; i<NC_NHASH; i++) {
+		nc_hash[i] = NULL;
+	}
+	nc_inuse = 0;
+}
+
+/*
+ * Look up NAME in DIR. Returns NC_FOUND (with the file number in
+ * *INO), NC_NOTFOUND, or NC_MISS.
+ */
+int
+namecache_lookup(struct vnode *dir, const char *name, uint32_t *ino)
+{
+	struct ncentry *nc;
+	int ret;
+
+	if (strlen(name) >= NC_NAMELEN) {
+		return NC_MISS;
+	}
+
+	spinlock_acquire(&nc_lock);
+	nc = nc_find(dir, name, NULL);
+	if (nc == NULL) {
+		ret = NC_MISS;
+	}
+	else {
+		if (nc->nc_negative) {
+			ret = NC_NOTFOUND;
+		}
+		else {
+			*ino = nc->nc_ino;
+			ret = NC_FOUND;
+		}
+		nc_lru_head(nc);
+	}
+	spinlock_release(&nc_lock);
+
+	cpustat_inc(ret == NC_MISS ? CPUSTAT_NCMISSES : CPUSTAT_NCHITS);
+	return ret;
+}
+
+/*
+ * Record that NAME in DIR is file number INO.
+ */
+void
+namecache_enter(struct vnode *dir, const char *name, uint32_t ino)
+{
+	nc_enter(dir, name, false, ino);
+}
+
+/*
+ * Record that there is no NAME in DIR.
+ */
+void
+namecache_enter_negative(struct vnode *dir, const char *name)
+{
+	nc_enter(dir, name, true, 0);
+}
+
+/*
+ * Forget whatever is known about NAME in DIR.
+ */
+void
+namecache_remove(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc, **prevp;
+
+	spinlock_acquire(&nc_lock);
+	nc = nc_find(dir, name, &prevp);
+	if (nc != NULL) {
+		nc_free(nc, prevp);
+	}
+	spinlock_release(&nc_lock);
+}
+
+/*
+ * Forget all the names in DIR. Called when the vnode goes away.
+ */
+void
+namecache_purge(struct vnode *dir)
+{
+	struct ncentry *nc, **prevp;
+	unsigned i;
+
+	spinlock_acquire(&nc_lock);
+	for (i=0; i<NC_NENTRIES && nc_inuse > 0; i++) {
+		nc = &nc_entries[i];
+		if (nc->nc_dir == dir) {
+			nc_find(dir, nc->nc_name, &prevp);
+			nc_free(nc, prevp);
+		}
+	}
+	spinlock_release(&nc_lock);
+}
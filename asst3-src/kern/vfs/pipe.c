@@ -0,0 +1,583 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Anonymous pipes.
+ *
+ * A pipe is a ring buffer of PIPE_SIZE bytes (a power of two) with
+ * free-running read and write positions; the count of buffered bytes
+ * is p_wpos - p_rpos. Each end is its own vnode, so we find out when
+ * the last reader or the last writer goes away from VOP_RECLAIM.
+ *
+ * Readers are serialized among themselves by p_rlock and writers by
+ * p_wlock, but a reader and a writer don't hold a common lock while
+ * copying: the reader only touches the bytes in [rpos, wpos) and the
+ * writer only the free space, and each only advances its own
+ * position. The spinlock p_lock covers the positions and the sleeping
+ * and waking, and is only held briefly.
+ *
+ * Wakeups are batched: a writer wakes the reader only when the pipe
+ * goes from empty to non-empty, and a reader wakes the writer only
+ * when the free space goes from less than to at least what the
+ * waiting writer needs. (Since each side is serialized, at most one
+ * reader and one writer can be asleep at a time.)
+ *
+ * Writes of up to PIPE_BUF bytes are atomic: the writer waits until
+ * there's room for the whole thing.
+ *
+ * For poll(), the read end is ready when there's data or no writer,
+ * and the write end when there's room for PIPE_BUF bytes or no
+ * reader. Pollers of both ends share p_pollq, which is woken on the
+ * same transitions as the sleeping reader and writer.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/*
+ * Size of the ring buffer. Must be a power of two, at least PIPE_BUF;
+ * allocated separately, and no bigger than a page, since we can't
+ * allocate multiple pages once the VM system is up.
+ */
+#define PIPE_SIZE	PAGE_SIZE
+
+
+struct pipe {
+	struct vnode p_readvn;		/* read end */
+	struct vnode p_writevn;		/* write end */
+
+	struct lock *p_rlock;		/* serializes readers */
+	struct lock *p_wlock;		/* serializes writers */
+
+	struct spinlock p_lock;		/* protects the following */
+	struct wchan *p_readwc;		/* reader waiting for data */
+	struct wchan *p_writewc;	/* writer waiting for space */
+	unsigned p_rpos;		/* read position (free-running) */
+	unsigned p_wpos;		/* write position (free-running) */
+	unsigned p_wneed;		/* space the sleeping writer needs */
+	bool p_readopen;		/* read end still exists */
+	bool p_writeopen;		/* write end still exists */
+	struct pollq p_pollq;		/* pollers of either end */
+
+	char *p_buf;			/* PIPE_SIZE bytes */
+};
+
+static const struct vnode_ops pipe_readops;
+static const struct vnode_ops pipe_writeops;
+
+////////////////////////////////////////////////////////////
+// Constructor and destructor
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	KASSERT(!p->p_readopen);
+	KASSERT(!p->p_writeopen);
+
+	vnode_cleanup(&p->p_readvn);
+	vnode_cleanup(&p->p_writevn);
+	pollq_cleanup(&p->p_pollq);
+	wchan_destroy(p->p_writewc);
+	wchan_destroy(p->p_readwc);
+	spinlock_cleanup(&p->p_lock);
+	lock_destroy(p->p_wlock);
+	lock_destroy(p->p_rlock);
+	kfree(p->p_buf);
+	kfree(p);
+}
+
+/*
+ * Make a pipe.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *p;
+	int result;
+
+	COMPILE_ASSERT((PIPE_SIZE & (PIPE_SIZE - 1)) == 0);
+	COMPILE_ASSERT(PIPE_SIZE >= PIPE_BUF);
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		kfree(p);
+		return ENOMEM;
+	}
+
+	p->p_rlock = lock_create("pipe-read");
+	if (p->p_rlock == NULL) {
+		goto fail_p;
+	}
+	p->p_wlock = lock_create("pipe-write");
+	if (p->p_wlock == NULL) {
+		goto fail_rlock;
+	}
+	spinlock_init(&p->p_lock);
+	p->p_readwc = wchan_create("pipe-read");
+	if (p->p_readwc == NULL) {
+		goto fail_wlock;
+	}
+	p->p_writewc = wchan_create("pipe-write");
+	if (p->p_writewc == NULL) {
+		goto fail_readwc;
+	}
+
+	result = vnode_init(&p->p_readvn, &pipe_readops, NULL, p);
+	if (result) {
+		goto fail_writewc;
+	}
+	result = vnode_init(&p->p_writevn, &pipe_writeops, NULL, p);
+	if (result) {
+		vnode_cleanup(&p->p_readvn);
+		goto fail_writewc;
+	}
+
+	p->p_rpos = p->p_wpos = 0;
+	p->p_wneed = 0;
+	p->p_readopen = true;
+	p->p_writeopen = true;
+	pollq_init(&p->p_pollq);
+
+	*readend = &p->p_readvn;
+	*writeend = &p->p_writevn;
+	return 0;
+
+ fail_writewc:
+	wchan_destroy(p->p_writewc);
+ fail_readwc:
+	wchan_destroy(p->p_readwc);
+ fail_wlock:
+	spinlock_cleanup(&p->p_lock);
+	lock_destroy(p->p_wlock);
+ fail_rlock:
+	lock_destroy(p->p_rlock);
+ fail_p:
+	kfree(p->p_buf);
+	kfree(p);
+	return ENOMEM;
+}
+
+////////////////////////////////////////////////////////////
+// Data transfer
+
+/*
+ * Move LEN bytes between the ring at position POS and UIO, wrapping
+ * around the end of the buffer if need be.
+ */
+static
+int
+pipe_uiomove(struct pipe *p, unsigned pos, size_t len, struct uio *uio)
+{
+	unsigned start, first;
+	int result;
+
+	start = pos & (PIPE_SIZE - 1);
+	first = PIPE_SIZE - start;
+	if (first > len) {
+		first = len;
+	}
+	result = uiomove(p->p_buf + start, first, uio);
+	if (result) {
+		return result;
+	}
+	if (len > first) {
+		result = uiomove(p->p_buf, len - first, uio);
+	}
+	return result;
+}
+
+/*
+ * Read. Wait until there's some data (or no writers left, which is
+ * EOF), then take as much as is there, up to what was asked for.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned avail, oldfree, newfree;
+	size_t len;
+	int result;
+
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_rlock);
+
+	spinlock_acquire(&p->p_lock);
+	while (p->p_wpos == p->p_rpos && p->p_writeopen) {
+		wchan_sleep(p->p_readwc, &p->p_lock);
+	}
+	avail = p->p_wpos - p->p_rpos;
+	spinlock_release(&p->p_lock);
+
+	len = uio->uio_resid;
+	if (len > avail) {
+		len = avail;
+	}
+
+	/* The writer won't touch these bytes until we advance p_rpos. */
+	result = pipe_uiomove(p, p->p_rpos, len, uio);
+	if (result) {
+		lock_release(p->p_rlock);
+		return result;
+	}
+
+	if (len > 0) {
+		spinlock_acquire(&p->p_lock);
+		oldfree = PIPE_SIZE - (p->p_wpos - p->p_rpos);
+		p->p_rpos += len;
+		newfree = oldfree + len;
+		if (p->p_wneed > 0 && oldfree < p->p_wneed &&
+		    newfree >= p->p_wneed) {
+			wchan_wakeone(p->p_writewc, &p->p_lock);
+		}
+		if (oldfree < PIPE_BUF && newfree >= PIPE_BUF) {
+			pollq_wakeup(&p->p_pollq);
+		}
+		spinlock_release(&p->p_lock);
+	}
+
+	lock_release(p->p_rlock);
+	return 0;
+}
+
+/*
+ * Write. Everything asked for is written, waiting for space as
+ * needed, unless the read end goes away (EPIPE). Writes of at most
+ * PIPE_BUF bytes go in all at once.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned need, space;
+	size_t len;
+	bool wasempty;
+	int result;
+
+	lock_acquire(p->p_wlock);
+
+	need = (uio->uio_resid <= PIPE_BUF) ? uio->uio_resid : 1;
+
+	while (uio->uio_resid > 0) {
+		spinlock_acquire(&p->p_lock);
+		while (p->p_readopen &&
+		       PIPE_SIZE - (p->p_wpos - p->p_rpos) < need) {
+			p->p_wneed = need;
+			wchan_sleep(p->p_writewc, &p->p_lock);
+		}
+		p->p_wneed = 0;
+		if (!p->p_readopen) {
+			spinlock_release(&p->p_lock);
+			lock_release(p->p_wlock);
+			return EPIPE;
+		}
+		space = PIPE_SIZE - (p->p_wpos - p->p_rpos);
+		spinlock_release(&p->p_lock);
+
+		len = uio->uio_resid;
+		if (len > space) {
+			len = space;
+		}
+
+		/* The reader won't touch free space until we advance p_wpos. */
+		result = pipe_uiomove(p, p->p_wpos, len, uio);
+		if (result) {
+			lock_release(p->p_wlock);
+			return result;
+		}
+
+		spinlock_acquire(&p->p_lock);
+		wasempty = (p->p_wpos == p->p_rpos);
+		p->p_wpos += len;
+		if (wasempty) {
+			wchan_wakeone(p->p_readwc, &p->p_lock);
+			pollq_wakeup(&p->p_pollq);
+		}
+		spinlock_release(&p->p_lock);
+
+		need = 1;
+	}
+
+	lock_release(p->p_wlock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Other vnode operations
+
+/*
+ * Pipes can't be opened by name, so this isn't called.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int flags)
+{
+	(void)vn;
+	(void)flags;
+	return 0;
+}
+
+/*
+ * Called when the last reference to one end goes away. Wake up
+ * anyone waiting on the other end so they can see EOF or EPIPE; if
+ * both ends are gone, free the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool destroy;
+
+	spinlock_acquire(&p->p_lock);
+
+	/* nobody else can find a pipe vnode, but check anyway */
+	if (!vnode_reclaimable(vn)) {
+		spinlock_release(&p->p_lock);
+		return EBUSY;
+	}
+
+	if (vn == &p->p_readvn) {
+		p->p_readopen = false;
+		wchan_wakeall(p->p_writewc, &p->p_lock);
+	}
+	else {
+		KASSERT(vn == &p->p_writevn);
+		p->p_writeopen = false;
+		wchan_wakeall(p->p_readwc, &p->p_lock);
+	}
+	pollq_wakeup(&p->p_pollq);
+	destroy = !p->p_readopen && !p->p_writeopen;
+
+	spinlock_release(&p->p_lock);
+
+	if (destroy) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Poll. Register first, then check, so a change in between still
+ * wakes the poller.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, struct pollset *ps)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned used;
+	int revents = 0;
+
+	if (ps != NULL) {
+		pollset_register(ps, &p->p_pollq);
+	}
+
+	spinlock_acquire(&p->p_lock);
+	used = p->p_wpos - p->p_rpos;
+	if (vn == &p->p_readvn) {
+		if (used > 0 || !p->p_writeopen) {
+			revents |= events & (POLLIN | POLLRDNORM);
+		}
+		if (!p->p_writeopen) {
+			revents |= POLLHUP;
+		}
+	}
+	else {
+		KASSERT(vn == &p->p_writevn);
+		if (!p->p_readopen) {
+			revents |= POLLERR;
+		}
+		else if (PIPE_SIZE - used >= PIPE_BUF) {
+			revents |= events & (POLLOUT | POLLWRNORM);
+		}
+	}
+	spinlock_release(&p->p_lock);
+
+	return revents;
+}
+
+/*
+ * Pipes have no ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+/*
+ * stat(): the size is the number of bytes buffered.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *statbuf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	spinlock_acquire(&p->p_lock);
+	statbuf->st_size = p->p_wpos - p->p_rpos;
+	spinlock_release(&p->p_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUF;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Each end only allows I/O in its own direction.
+ */
+static
+int
+pipe_badrw(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return EBADF;
+}
+
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_badrw,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_nosys,
+	.vop_poll = pipe_poll,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_badrw,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_nosys,
+	.vop_poll = pipe_poll,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Readiness notification for poll() and select() (see poll.h).
+ *
+ * Each registration is a pollent, which is on two lists at once: its
+ * pollq's list, protected by the pollq's lock, and its pollset's
+ * array. The entries are allocated along with the pollset.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <timer.h>
+#include <poll.h>
+
+struct pollent {
+	struct pollset *pe_set;		/* who to wake */
+	struct pollq *pe_q;		/* where we're registered */
+	struct pollent *pe_next;	/* next on pe_q's list */
+};
+
+struct pollset {
+	struct spinlock ps_lock;	/* protects ps_fired */
+	struct wchan *ps_wchan;		/* poller sleeps here */
+	bool ps_fired;			/* woken since last wait */
+	unsigned ps_nents;		/* registrations made */
+	unsigned ps_maxents;		/* registrations allowed */
+	struct pollent *ps_ents;	/* array of ps_maxents */
+};
+
+////////////////////////////////////////////////////////////
+// pollq
+
+void
+pollq_init(struct pollq *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_ents = NULL;
+}
+
+void
+pollq_cleanup(struct pollq *pq)
+{
+	KASSERT(pq->pq_ents == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake up every pollset registered on PQ. The pollsets stay
+ * registered; a poller rescans everything when it wakes.
+ */
+void
+pollq_wakeup(struct pollq *pq)
+{
+	struct pollent *pe;
+	struct pollset *ps;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_ents; pe != NULL; pe = pe->pe_next) {
+		ps = pe->pe_set;
+		spinlock_acquire(&ps->ps_lock);
+		ps->ps_fired = true;
+		wchan_wakeall(ps->ps_wchan, &ps->ps_lock);
+		spinlock_release(&ps->ps_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollset
+
+struct pollset *
+pollset_create(unsigned maxents)
+{
+	struct pollset *ps;
+
+	ps = kmalloc(sizeof(*ps));
+	if (ps == NULL) {
+		return NULL;
+	}
+	ps->ps_ents = NULL;
+	if (maxents > 0) {
+		ps->ps_ents = kmalloc(maxents * sizeof(ps->ps_ents[0]));
+		if (ps->ps_ents == NULL) {
+			kfree(ps);
+			return NULL;
+		}
+	}
+	ps->ps_wchan = wchan_create("pollset");
+	if (ps->ps_wchan == NULL) {
+		kfree(ps->ps_ents);
+		kfree(ps);
+		return NULL;
+	}
+	spinlock_init(&ps->ps_lock);
+	ps->ps_fired = false;
+	ps->ps_nents = 0;
+	ps->ps_maxents = maxents;
+	return ps;
+}
+
+/*
+ * Take the pollset off all the pollqs it was registered on. Once
+ * this is done no pollq_wakeup can reach it.
+ */
+void
+pollset_destroy(struct pollset *ps)
+{
+	struct pollent *pe, **pep;
+	struct pollq *pq;
+	unsigned i;
+
+	for (i=0; i<ps->ps_nents; i++) {
+		pe = &ps->ps_ents[i];
+		pq = pe->pe_q;
+		spinlock_acquire(&pq->pq_lock);
+		for (pep = &pq->pq_ents; *pep != pe; pep = &(*pep)->pe_next) {
+			KASSERT(*pep != NULL);
+		}
+		*pep = pe->pe_next;
+		spinlock_release(&pq->pq_lock);
+	}
+
+	spinlock_cleanup(&ps->ps_lock);
+	wchan_destroy(ps->ps_wchan);
+	kfree(ps->ps_ents);
+	kfree(ps);
+}
+
+/*
+ * Put the pollset on PQ's list.
+ */
+void
+pollset_register(struct pollset *ps, struct pollq *pq)
+{
+	struct pollent *pe;
+
+	KASSERT(ps->ps_nents < ps->ps_maxents);
+
+	pe = &ps->ps_ents[ps->ps_nents++];
+	pe->pe_set = ps;
+	pe->pe_q = pq;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_ents;
+	pq->pq_ents = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+bool
+pollset_wait(struct pollset *ps, uint64_t nsecs)
+{
+	bool woken;
+
+	spinlock_acquire(&ps->ps_lock);
+	while (!ps->ps_fired) {
+		if (nsecs == 0) {
+			wchan_sleep(ps->ps_wchan, &ps->ps_lock);
+		}
+		else if (!timer_wchan_sleep(ps->ps_wchan, &ps->ps_lock,
+					    nsecs)) {
+			break;
+		}
+	}
+	woken = ps->ps_fired;
+	ps->ps_fired = false;
+	spinlock_release(&ps->ps_lock);
+
+	return woken;
+}
@@ -43,6 +43,7 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <namecache.h>
 
 /*
  * Structure for a single named device.
@@ -112,6 +113,8 @@ vfs_bootstrap(void)
 	}
 	vfs_biglock_depth = 0;
 
+	namecache_bootstrap();
+	devreq_bootstrap();
 	devnull_create();
 	semfs_bootstrap();
 }
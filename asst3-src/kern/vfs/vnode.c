@@ -33,9 +33,12 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <atomic.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <poll.h>
+#include <namecache.h>
 
 /*
  * Initialize an abstract vnode.
@@ -49,7 +52,6 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
-	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -63,7 +65,8 @@ vnode_cleanup(struct vnode *vn)
 {
 	KASSERT(vn->vn_refcount == 1);
 
-	spinlock_cleanup(&vn->vn_countlock);
+	/* The pointer may be reused for another directory. */
+	namecache_purge(vn);
 
 	vn->vn_ops = NULL;
 	vn->vn_refcount = 0;
@@ -81,9 +84,7 @@ vnode_incref(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	spinlock_acquire(&vn->vn_countlock);
-	vn->vn_refcount++;
-	spinlock_release(&vn->vn_countlock);
+	atomic_add(&vn->vn_refcount, 1);
 }
 
 /*
@@ -98,19 +99,15 @@ vnode_decref(struct vnode *vn)
 	int result;
 
 	KASSERT(vn != NULL);
-
-	spinlock_acquire(&vn->vn_countlock);
-
 	KASSERT(vn->vn_refcount > 0);
-	if (vn->vn_refcount > 1) {
-		vn->vn_refcount--;
-		destroy = false;
-	}
-	else {
-		/* Don't decrement; pass the reference to VOP_RECLAIM. */
-		destroy = true;
-	}
-	spinlock_release(&vn->vn_countlock);
+
+	/*
+	 * If this is the last reference, don't decrement; pass the
+	 * reference to VOP_RECLAIM. Reclaim must recheck the count
+	 * under the filesystem's own lock (with vnode_reclaimable), in
+	 * case someone picked the vnode up again in the meantime.
+	 */
+	destroy = !atomic_add_unless(&vn->vn_refcount, -1, 1);
 
 	if (destroy) {
 		result = VOP_RECLAIM(vn);
@@ -122,6 +119,23 @@ vnode_decref(struct vnode *vn)
 	}
 }
 
+/*
+ * Called by VOP_RECLAIM, holding whatever filesystem lock keeps new
+ * references from being handed out, to make sure nobody else has
+ * picked up the vnode since VOP_DECREF decided to reclaim it. If
+ * someone has, consumes the reference VOP_DECREF passed along and
+ * returns false; the reclaim should then fail with EBUSY.
+ */
+bool
+vnode_reclaimable(struct vnode *vn)
+{
+	if (atomic_add_unless(&vn->vn_refcount, -1, 1)) {
+		return false;
+	}
+	KASSERT(vn->vn_refcount == 1);
+	return true;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
@@ -129,6 +143,8 @@ vnode_decref(struct vnode *vn)
 void
 vnode_check(struct vnode *v, const char *opstr)
 {
+	int refcount;
+
 	/* not safe, and not really needed to check constant fields */
 	/*vfs_biglock_acquire();*/
 
@@ -159,20 +175,33 @@ vnode_check(struct vnode *v, const char *opstr)
 		panic("vnode_check: vop_%s: deadbeef fs pointer\n", opstr);
 	}
 
-	spinlock_acquire(&v->vn_countlock);
-
-	if (v->vn_refcount < 0) {
+	refcount = v->vn_refcount;
+	if (refcount < 0) {
 		panic("vnode_check: vop_%s: negative refcount %d\n", opstr,
-		      v->vn_refcount);
+		      refcount);
 	}
-	else if (v->vn_refcount == 0) {
+	else if (refcount == 0) {
 		panic("vnode_check: vop_%s: zero refcount\n", opstr);
 	}
-	else if (v->vn_refcount > 0x100000) {
+	else if (refcount > 0x100000) {
 		kprintf("vnode_check: vop_%s: warning: large refcount %d\n",
-			opstr, v->vn_refcount);
+			opstr, refcount);
 	}
 
-	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
+
+/*
+ * Poll a vnode. Objects that don't implement vop_poll never block,
+ * so they are always ready for reading and writing.
+ */
+int
+vnode_poll(struct vnode *vn, int events, struct pollset *ps)
+{
+	vnode_check(vn, "poll");
+
+	if (vn->vn_ops->vop_poll == NULL) {
+		return events & POLL_ALWAYS;
+	}
+	return vn->vn_ops->vop_poll(vn, events, ps);
+}
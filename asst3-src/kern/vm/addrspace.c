@@ -32,6 +32,7 @@
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <synch.h>
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
@@ -60,8 +61,23 @@ as_create(void)
 		return NULL;
 	}
 
+	as->regionlock = rwlock_create("regions");
+	if (as->regionlock == NULL) {
+	    kfree(as);
+	    return NULL;
+	}
+
+	as->ptlock = lock_create("pagetable");
+	if (as->ptlock == NULL) {
+	    rwlock_destroy(as->regionlock);
+	    kfree(as);
+	    return NULL;
+	}
+
 	as->ptable = (paddr_t **)alloc_kpages(1);
 	if (as->ptable == NULL) {
+	    lock_destroy(as->ptlock);
+	    rwlock_destroy(as->regionlock);
 	    kfree(as);
 	    return NULL;
     }
@@ -73,6 +89,7 @@ as_create(void)
 	    as->ptable[i] = NULL;
 	}
 	as->regions = NULL;
+	as->threadstacks = 0;
 	return as;
 }
 
@@ -90,6 +107,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
     int dirty;
 	
     /* Copy regions from old to new address space */
+    rwlock_acquire_read(old->regionlock);
     struct region *cur_old = old->regions;
     struct region *cur_new = newas->regions;
     /* Regions are implemented as a linked list, 
@@ -98,6 +116,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
     while (cur_old != NULL) {
         struct region *reg = kmalloc(sizeof(struct region));
         if (reg == NULL) {
+            rwlock_release_read(old->regionlock);
             as_destroy(newas);
             return ENOMEM;
         }
@@ -114,9 +133,14 @@ as_copy(struct addrspace *old, struct addrspace **ret)
         cur_new = reg;
         cur_old = cur_old->next;
     }
+    newas->threadstacks = old->threadstacks;
+    rwlock_release_read(old->regionlock);
 
-    /* Now, deep copy the page table. */
+    /* Now, deep copy the page table. Other threads in the old
+     * address space may be faulting pages in while we do this.
+     */
     int i, j;
+    lock_acquire(old->ptlock);
     for (i = 0; i < PAGETABLE_SIZE; i++) {
         if (old->ptable[i] != NULL) {
             newas->ptable[i] = kmalloc(sizeof(paddr_t)*PAGETABLE_SIZE);
@@ -132,6 +156,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
             }
         }
     }
+    lock_release(old->ptlock);
     *ret = newas;
     return 0;
 }
@@ -168,6 +193,8 @@ as_destroy(struct addrspace *as)
     if (prev != NULL) {
         kfree(prev);
     }
+    lock_destroy(as->ptlock);
+    rwlock_destroy(as->regionlock);
 
     /* Free the struct address space itself. */
     kfree(as);
@@ -259,8 +286,10 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
     reg->old_writeable_bit = reg->writeable_bit;
     reg->next = NULL;
     
-    /* Add the new region to the list of regions. */
-    if (as->regions == NULL) {
+    /* Add the new region to the list of regions, keeping it sorted. */
+    rwlock_acquire_write(as->regionlock);
+    if (as->regions == NULL || reg->vbase < as->regions->vbase) {
+        reg->next = as->regions;
         as->regions = reg;
     } else {
         struct region *cur, *prev;
@@ -272,6 +301,7 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
         prev->next = reg;
         reg->next = cur;
     }
+    rwlock_release_write(as->regionlock);
     
     /* Current implementation only cares about whether 
      * the region is writeable or not. 
@@ -288,11 +318,13 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 int
 as_prepare_load(struct addrspace *as)
 {
+    rwlock_acquire_write(as->regionlock);
     struct region *cur = as->regions;
     while (cur != NULL) {
         cur->writeable_bit = 1;
         cur = cur->next;
     }
+    rwlock_release_write(as->regionlock);
     return 0;
 }
 
@@ -303,11 +335,13 @@ as_prepare_load(struct addrspace *as)
 int
 as_complete_load(struct addrspace *as)
 {
+    rwlock_acquire_write(as->regionlock);
     struct region *cur = as->regions;
     while (cur != NULL) {
         cur->writeable_bit = cur->old_writeable_bit;
         cur = cur->next;
     }
+    rwlock_release_write(as->regionlock);
 
     /* After changing the write permission of read-only regions,
      * flush the TLB in case it still caches read-only regions
@@ -338,3 +372,36 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
     return 0;
 }
 
+/* Define the user stack for user thread number SLOT. Thread stacks
+ * sit below the regular stack (slot 0), each with an unmapped page
+ * underneath so that running off the bottom of one faults instead of
+ * scribbling on the next. Set the thread's stack pointer at the top.
+ */
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+    vaddr_t stacktop = USERSTACK - slot * (USERSTACKSIZE + PAGE_SIZE);
+    uint32_t mask = (uint32_t)1 << slot;
+    bool defined;
+
+    KASSERT(slot > 0 && slot < 32);
+
+    /* The caller owns the slot, so nobody else defines it meanwhile. */
+    rwlock_acquire_read(as->regionlock);
+    defined = (as->threadstacks & mask) != 0;
+    rwlock_release_read(as->regionlock);
+
+    if (!defined) {
+        int result = as_define_region(as, stacktop - USERSTACKSIZE, USERSTACKSIZE, 1, 1, 1);
+        if (result) {
+            return result;
+        }
+        rwlock_acquire_write(as->regionlock);
+        as->threadstacks |= mask;
+        rwlock_release_write(as->regionlock);
+    }
+
+    *stackptr = stacktop;
+
+    return 0;
+}
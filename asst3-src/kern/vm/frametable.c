@@ -31,7 +31,7 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 /* Frametable is shared between processes, hence it needs a lock.
  * Spinlock make sure it can be obtained during context switch.
  */
-static struct spinlock frametable_lock = SPINLOCK_INITIALIZER;
+static struct spinlock frametable_lock = SPINLOCK_TICKET_INITIALIZER;
 
 /* Frametable initialisation function, called from vm_bootstrap */	
 void frametable_init() {
@@ -9,6 +9,9 @@
 #include <proc.h>
 #include <copyinout.h>
 #include <spl.h>
+#include <synch.h>
+#include <cpustat.h>
+#include <trace.h>
 
 /* Place your page table functions here */
 
@@ -72,6 +75,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
      */
     bool flag = false;
     int result;
+
+    cpustat_inc(CPUSTAT_VMFAULTS);
+    TRACE(TRACE_VMFAULT, faulttype, faultaddress);
     
     /* Current implementation only handle faulttype read and write. */
     switch (faulttype) {
@@ -103,10 +109,16 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     /* Second page table index. */
     uint32_t lsb = paddr << 10 >> 22;
     
+    /* Threads sharing this address space may fault at the same time;
+     * hold the pagetable lock while looking up and filling in entries.
+     */
+    lock_acquire(cur_as->ptlock);
+
     /* Allocate a new 2nd level pagetable if the root entry is still NULL. */
     if (pagetable[msb] == NULL) {
         result = vm_add_root_ptentry(pagetable, msb);
         if (result) {
+            lock_release(cur_as->ptlock);
             return result;
         }
         flag = true;
@@ -114,6 +126,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     
     /* Allocate a new 2nd level pagetable entry in case we can't find the entry. */
     if (pagetable[msb][lsb] == 0) {      
+        rwlock_acquire_read(cur_as->regionlock);
         struct region *cur = cur_as->regions;
         /* If pagetable entry doesn't exist, check if the address is a valid virtual address inside a region */
         while (cur != NULL) {
@@ -128,11 +141,14 @@ vm_fault(int faulttype, vaddr_t faultaddress)
             }
             cur = cur->next;
         }
+        rwlock_release_read(cur_as->regionlock);
         /* If address is not in region, return bad memory error code. */
 		if (cur == NULL) {
             if (flag == true) {
                 kfree(pagetable[msb]);
+                pagetable[msb] = NULL;
             }
+            lock_release(cur_as->ptlock);
             return EFAULT;
         }
         
@@ -140,7 +156,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
         if (result) {
             if (flag == true) {
                 kfree(pagetable[msb]);
+                pagetable[msb] = NULL;
             }
+            lock_release(cur_as->ptlock);
             return result;
         }
     }	
@@ -149,6 +167,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     entry_hi = faultaddress & PAGE_FRAME;
     /* Entry low is physical frame, dirty bit, and valid bit. */
     entry_lo = pagetable[msb][lsb];
+    lock_release(cur_as->ptlock);
 	/* Disable interrupts on this CPU while frobbing the TLB. */
     int spl = splhigh();
     /* Randomly add pagetable entry to the TLB. */
@@ -36,6 +36,7 @@
 
 /* Get the limits the kernel exports. libc doesn't have any limits :-) */
 #include <kern/limits.h>
+#include <kern/types.h>	/* for __SSIZE_MAX */
 
 /* Provide the real names */
 #define NAME_MAX        __NAME_MAX
@@ -48,6 +49,7 @@
 #define LOGIN_NAME_MAX  __LOGIN_NAME_MAX
 #define OPEN_MAX        __OPEN_MAX
 #define IOV_MAX         __IOV_MAX
+#define SSIZE_MAX       __SSIZE_MAX
 
 
 #endif /* _LIMITS_H_ */
@@ -40,8 +40,12 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/limits.h>
+#include <kern/poll.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/select.h>
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
@@ -144,10 +148,27 @@ void *sbrk(__intptr_t change);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t preadv(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+ssize_t pwritev(int filehandle, const struct iovec *iov, int iovcnt,
+		off_t pos);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int poll(struct pollfd *fds, unsigned nfds, int timeout);
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+	   struct timeval *timeout);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int __threadfork(void (*entry)(void *), void *arg);
+__DEAD void threadexit(int status);
+int threadjoin(int tid, int *status);
+int futex_wait(volatile int *addr, int val, const struct timespec *timeout);
+int futex_wake(volatile int *addr, int count);
+int setaffinity(unsigned mask);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -158,6 +179,7 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int threadfork(void (*func)(void));		/* calls __threadfork */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
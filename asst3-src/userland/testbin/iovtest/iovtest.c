@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * iovtest - test readv, writev, pread, pwrite, preadv, and pwritev.
+ *
+ * Checks that:
+ *    - writev and readv gather and scatter across several buffers;
+ *    - up to IOV_MAX iovecs work, and more, or none, fail with EINVAL;
+ *    - iovecs adding up to more than SSIZE_MAX fail with EINVAL;
+ *    - pread and pwrite (and the v versions) use the offset they're
+ *      given, all 64 bits of it, and leave the seek position alone.
+ *
+ * Creates and removes a scratch file in the current directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define TESTFILE "iovtest.tmp"
+
+/* Written in three pieces and read back in three others */
+static const char slogan[] = "The quick brown fox jumps over the lazy dog.";
+
+/* An offset past 4G that's SLOGANPOS if the upper 32 bits are lost */
+#define SLOGANPOS	5
+#define HUGEPOS		(((off_t)1 << 32) + SLOGANPOS)
+
+static struct iovec iov[IOV_MAX + 1];
+static char buf[IOV_MAX + 1];
+
+static
+int
+doopen(const char *path, int flags)
+{
+	int fd;
+
+	fd = open(path, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	return fd;
+}
+
+static
+off_t
+getpos(int fd)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "lseek");
+	}
+	return pos;
+}
+
+static
+void
+setpos(int fd, off_t pos)
+{
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+}
+
+/*
+ * Die unless R, from the call WHAT, is EXPECT.
+ */
+static
+void
+checklen(const char *what, ssize_t r, size_t expect)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)r != expect) {
+		errx(1, "%s: got %zd bytes, expected %zu", what, r, expect);
+	}
+}
+
+/*
+ * Die unless R, from the call WHAT, is a failure with EINVAL.
+ */
+static
+void
+checkeinval(const char *what, ssize_t r)
+{
+	if (r >= 0) {
+		errx(1, "%s: succeeded (%zd), expected EINVAL", what, r);
+	}
+	if (errno != EINVAL) {
+		err(1, "%s: expected EINVAL, got", what);
+	}
+}
+
+/*
+ * Die unless the seek position of FD is POS.
+ */
+static
+void
+checkpos(const char *what, int fd, off_t pos)
+{
+	off_t cur;
+
+	cur = getpos(fd);
+	if (cur != pos) {
+		errx(1, "%s: seek position %lld, expected %lld",
+		     what, (long long)cur, (long long)pos);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+test_gather_scatter(int fd)
+{
+	char a[7], b[20], c[64];
+	size_t len;
+	ssize_t r;
+
+	printf("writev and readv...\n");
+
+	len = strlen(slogan);
+
+	/* Write it in pieces of 10, 15, and the rest */
+	iov[0].iov_base = (void *)slogan;
+	iov[0].iov_len = 10;
+	iov[1].iov_base = (void *)(slogan + 10);
+	iov[1].iov_len = 15;
+	iov[2].iov_base = (void *)(slogan + 25);
+	iov[2].iov_len = len - 25;
+	setpos(fd, 0);
+	r = writev(fd, iov, 3);
+	checklen("writev", r, len);
+	checkpos("writev", fd, len);
+
+	/* Read it back in pieces of 7, 20, and the rest */
+	iov[0].iov_base = a;
+	iov[0].iov_len = sizeof(a);
+	iov[1].iov_base = b;
+	iov[1].iov_len = sizeof(b);
+	iov[2].iov_base = c;
+	iov[2].iov_len = sizeof(c);
+	setpos(fd, 0);
+	r = readv(fd, iov, 3);
+	checklen("readv", r, len);
+	checkpos("readv", fd, len);
+	if (memcmp(a, slogan, sizeof(a)) != 0 ||
+	    memcmp(b, slogan + sizeof(a), sizeof(b)) != 0 ||
+	    memcmp(c, slogan + sizeof(a) + sizeof(b),
+		   len - sizeof(a) - sizeof(b)) != 0) {
+		errx(1, "readv: wrong data");
+	}
+}
+
+static
+void
+test_iovcnt(int fd)
+{
+	unsigned i;
+	ssize_t r;
+
+	printf("iovec counts...\n");
+
+	for (i=0; i<IOV_MAX + 1; i++) {
+		buf[i] = 'a' + i % 26;
+		iov[i].iov_base = &buf[i];
+		iov[i].iov_len = 1;
+	}
+
+	setpos(fd, 0);
+	r = writev(fd, iov, IOV_MAX);
+	checklen("writev of IOV_MAX", r, IOV_MAX);
+
+	r = writev(fd, iov, IOV_MAX + 1);
+	checkeinval("writev of IOV_MAX+1", r);
+
+	r = writev(fd, iov, 0);
+	checkeinval("writev of 0", r);
+
+	/* Scatter it back one byte per iovec, backwards */
+	for (i=0; i<IOV_MAX; i++) {
+		iov[i].iov_base = &buf[IOV_MAX - 1 - i];
+	}
+	memset(buf, 0, sizeof(buf));
+	setpos(fd, 0);
+	r = readv(fd, iov, IOV_MAX);
+	checklen("readv of IOV_MAX", r, IOV_MAX);
+	for (i=0; i<IOV_MAX; i++) {
+		if (buf[IOV_MAX - 1 - i] != (char)('a' + i % 26)) {
+			errx(1, "readv of IOV_MAX: wrong data at %u", i);
+		}
+	}
+}
+
+static
+void
+test_ssize_max(void)
+{
+	unsigned i, n;
+	ssize_t r;
+	int fd;
+
+	printf("Lengths past SSIZE_MAX...\n");
+
+	fd = doopen("null:", O_WRONLY);
+
+	/*
+	 * Repeat one small buffer with a huge length. The length is
+	 * checked before anything is copied, so it doesn't matter
+	 * that the buffer isn't that big.
+	 */
+	n = SSIZE_MAX / (SSIZE_MAX / 4) + 1;
+	for (i=0; i<n; i++) {
+		iov[i].iov_base = buf;
+		iov[i].iov_len = SSIZE_MAX / 4;
+	}
+	r = writev(fd, iov, n);
+	checkeinval("writev past SSIZE_MAX", r);
+
+	/* One past, exactly */
+	iov[0].iov_len = SSIZE_MAX;
+	iov[1].iov_len = 1;
+	r = writev(fd, iov, 2);
+	checkeinval("writev of SSIZE_MAX+1", r);
+
+	close(fd);
+}
+
+static
+void
+test_positioned(int fd)
+{
+	char tmp[sizeof(slogan)];
+	size_t len;
+	ssize_t r;
+
+	printf("pread, pwrite, preadv, and pwritev...\n");
+
+	len = strlen(slogan);
+
+	/* Lay down a fresh copy and leave the seek position mid-file */
+	setpos(fd, 0);
+	checklen("write", write(fd, slogan, len), len);
+	setpos(fd, 3);
+
+	r = pread(fd, tmp, 9, SLOGANPOS);
+	checklen("pread", r, 9);
+	if (memcmp(tmp, slogan + SLOGANPOS, 9) != 0) {
+		errx(1, "pread: wrong data");
+	}
+	checkpos("pread", fd, 3);
+
+	r = pwrite(fd, "QUICK", 5, 4);
+	checklen("pwrite", r, 5);
+	checkpos("pwrite", fd, 3);
+	r = read(fd, tmp, 6);
+	checklen("read after pwrite", r, 6);
+	if (memcmp(tmp, " QUICK", 6) != 0) {
+		errx(1, "pwrite: data not at the given offset");
+	}
+	checkpos("read after pwrite", fd, 9);
+
+	iov[0].iov_base = (void *)"BROWN";
+	iov[0].iov_len = 5;
+	r = pwritev(fd, iov, 1, 10);
+	checklen("pwritev", r, 5);
+	checkpos("pwritev", fd, 9);
+
+	iov[0].iov_base = tmp;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = tmp + 4;
+	iov[1].iov_len = 7;
+	r = preadv(fd, iov, 2, 4);
+	checklen("preadv", r, 11);
+	if (memcmp(tmp, "QUICK BROWN", 11) != 0) {
+		errx(1, "preadv: wrong data");
+	}
+	checkpos("preadv", fd, 9);
+
+	/*
+	 * The offset is 64 bits and passed on the stack; past 4G the
+	 * file has nothing, so if the top half got lost we'd see the
+	 * data at SLOGANPOS instead of EOF.
+	 */
+	r = pread(fd, tmp, 9, HUGEPOS);
+	checklen("pread past 4G", r, 0);
+	checkpos("pread past 4G", fd, 9);
+}
+
+int
+main(void)
+{
+	int fd;
+
+	fd = doopen(TESTFILE, O_RDWR|O_CREAT|O_TRUNC);
+	test_gather_scatter(fd);
+	test_iovcnt(fd);
+	test_positioned(fd);
+	close(fd);
+	if (remove(TESTFILE) < 0) {
+		err(1, "%s: remove", TESTFILE);
+	}
+
+	test_ssize_max();
+
+	printf("Passed iovtest.\n");
+	return 0;
+}
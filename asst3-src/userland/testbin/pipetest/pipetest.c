@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * pipetest - test pipes.
+ *
+ * Checks that:
+ *    - the reader sees EOF once the writer closes;
+ *    - writing with no reader fails with EPIPE;
+ *    - PIPE_BUF-sized writes from two writers don't get mixed up;
+ *    - a writer that fills the pipe waits, and goes on once the
+ *      reader makes room.
+ *
+ * Needs fork, waitpid, pipe, poll, and nanosleep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+/* Number of PIPE_BUF-sized writes each writer makes in test_atomic */
+#define NCHUNKS 64
+
+/* Amount written in test_block; bigger than any pipe's buffer */
+#define BIGWRITE (16 * 1024)
+
+static char buf[BIGWRITE];
+
+static
+void
+dopipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+void
+doclose(int fd)
+{
+	if (close(fd) < 0) {
+		err(1, "close");
+	}
+}
+
+static
+pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: signal %d", pid, WTERMSIG(status));
+	}
+	if (WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+}
+
+/*
+ * Write all of LEN bytes, or die.
+ */
+static
+void
+writeall(int fd, const char *data, size_t len)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(fd, data, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		data += r;
+		len -= r;
+	}
+}
+
+/*
+ * Read until LEN bytes or EOF. Returns the number of bytes read.
+ */
+static
+size_t
+readall(int fd, char *data, size_t len)
+{
+	size_t got;
+	ssize_t r;
+
+	got = 0;
+	while (got < len) {
+		r = read(fd, data + got, len - got);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		got += r;
+	}
+	return got;
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+test_eof(void)
+{
+	static const char msg[] = "Hello, pipe.";
+	int fds[2];
+	size_t n;
+
+	printf("EOF after the writer closes...\n");
+
+	dopipe(fds);
+	writeall(fds[1], msg, strlen(msg));
+	doclose(fds[1]);
+
+	n = readall(fds[0], buf, sizeof(buf));
+	if (n != strlen(msg)) {
+		errx(1, "Read %zu bytes, expected %zu", n, strlen(msg));
+	}
+	if (memcmp(buf, msg, n) != 0) {
+		errx(1, "Read the wrong data");
+	}
+	/* Again, to make sure EOF sticks */
+	if (read(fds[0], buf, sizeof(buf)) != 0) {
+		errx(1, "No EOF on second read");
+	}
+	doclose(fds[0]);
+}
+
+static
+void
+test_epipe(void)
+{
+	int fds[2];
+	ssize_t r;
+
+	printf("EPIPE after the reader closes...\n");
+
+	dopipe(fds);
+	doclose(fds[0]);
+
+	r = write(fds[1], "x", 1);
+	if (r >= 0) {
+		errx(1, "write with no reader succeeded");
+	}
+	if (errno != EPIPE) {
+		err(1, "write with no reader: expected EPIPE, got");
+	}
+	doclose(fds[1]);
+}
+
+static
+void
+atomic_writer(int fd, char ch)
+{
+	char chunk[PIPE_BUF];
+	unsigned i;
+
+	memset(chunk, ch, sizeof(chunk));
+	for (i=0; i<NCHUNKS; i++) {
+		writeall(fd, chunk, sizeof(chunk));
+	}
+	_exit(0);
+}
+
+static
+void
+test_atomic(void)
+{
+	char chunk[PIPE_BUF];
+	unsigned i, count[2];
+	pid_t pid[2];
+	int fds[2];
+	size_t n;
+
+	printf("PIPE_BUF writes from two writers...\n");
+
+	dopipe(fds);
+	for (i=0; i<2; i++) {
+		pid[i] = dofork();
+		if (pid[i] == 0) {
+			doclose(fds[0]);
+			atomic_writer(fds[1], 'a' + i);
+		}
+	}
+	doclose(fds[1]);
+
+	/*
+	 * Each write went in as a unit, so every PIPE_BUF-sized piece
+	 * of what comes out should be all one writer's.
+	 */
+	count[0] = count[1] = 0;
+	while ((n = readall(fds[0], chunk, sizeof(chunk))) > 0) {
+		if (n != sizeof(chunk)) {
+			errx(1, "Short chunk (%zu bytes) at EOF", n);
+		}
+		if (chunk[0] != 'a' && chunk[0] != 'b') {
+			errx(1, "Read junk");
+		}
+		for (i=1; i<sizeof(chunk); i++) {
+			if (chunk[i] != chunk[0]) {
+				errx(1, "Writes were interleaved");
+			}
+		}
+		count[chunk[0] - 'a']++;
+	}
+	doclose(fds[0]);
+
+	for (i=0; i<2; i++) {
+		dowait(pid[i]);
+		if (count[i] != NCHUNKS) {
+			errx(1, "Got %u chunks from writer %u, expected %u",
+			     count[i], i, NCHUNKS);
+		}
+	}
+}
+
+static
+void
+test_block(void)
+{
+	struct timespec ts;
+	struct pollfd pfd;
+	int fds[2], done[2];
+	size_t n, i;
+	pid_t pid;
+	char ch;
+
+	printf("Writer waits for room...\n");
+
+	dopipe(fds);
+	dopipe(done);
+	pid = dofork();
+	if (pid == 0) {
+		doclose(fds[0]);
+		doclose(done[0]);
+		for (i=0; i<sizeof(buf); i++) {
+			buf[i] = i % 251;
+		}
+		writeall(fds[1], buf, sizeof(buf));
+		/* Tell the parent we got through */
+		writeall(done[1], "x", 1);
+		_exit(0);
+	}
+	doclose(fds[1]);
+	doclose(done[1]);
+
+	/* Give the writer plenty of time to fill the pipe. */
+	ts.tv_sec = 1;
+	ts.tv_nsec = 0;
+	if (nanosleep(&ts, NULL) < 0) {
+		err(1, "nanosleep");
+	}
+
+	/* It should be stuck, not finished. */
+	pfd.fd = done[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) < 0) {
+		err(1, "poll");
+	}
+	if (pfd.revents != 0) {
+		errx(1, "Writer didn't wait for the reader");
+	}
+
+	/* Draining the pipe should let it finish. */
+	n = readall(fds[0], buf, sizeof(buf));
+	if (n != sizeof(buf)) {
+		errx(1, "Read %zu bytes, expected %zu", n, sizeof(buf));
+	}
+	for (i=0; i<n; i++) {
+		if ((unsigned char)buf[i] != i % 251) {
+			errx(1, "Wrong data at offset %zu", i);
+		}
+	}
+	if (readall(done[0], &ch, 1) != 1) {
+		errx(1, "Writer didn't finish");
+	}
+	doclose(fds[0]);
+	doclose(done[0]);
+	dowait(pid);
+}
+
+int
+main(void)
+{
+	test_eof();
+	test_epipe();
+	test_atomic();
+	test_block();
+	printf("Passed pipetest.\n");
+	return 0;
+}
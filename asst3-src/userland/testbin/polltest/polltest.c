@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * polltest - test poll() and select() on pipes.
+ *
+ * Checks that:
+ *    - poll with a timeout of 0 returns right away;
+ *    - poll with a finite timeout waits about that long;
+ *    - poll with an infinite timeout returns when there's data,
+ *      including when the other end writes while we wait;
+ *    - select with no sets at all just waits out the timeout;
+ *    - select waits out the timeout for a condition it wasn't asked
+ *      about (a hangup on a file only in the exception set);
+ *    - select reports a readable pipe in the read set;
+ *    - select on a file handle that isn't open fails with EBADF.
+ *
+ * Needs fork, waitpid, pipe, and nanosleep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+/* Finite timeouts used, in milliseconds */
+#define TIMEOUT_MS 500
+
+/* How early a timed wait may end, in milliseconds, for clock slop */
+#define SLOP_MS 50
+
+static
+void
+dopipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+void
+doclose(int fd)
+{
+	if (close(fd) < 0) {
+		err(1, "close");
+	}
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: signal %d", pid, WTERMSIG(status));
+	}
+	if (WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+}
+
+/*
+ * Current time in milliseconds.
+ */
+static
+unsigned long
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (unsigned long)secs * 1000 + nsecs / 1000000;
+}
+
+/*
+ * Poll FD for EVENTS with TIMEOUT; die if it fails or doesn't return
+ * EXPECT. Returns the revents.
+ */
+static
+short
+dopoll(int fd, short events, int timeout, int expect)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "poll");
+	}
+	if (r != expect) {
+		errx(1, "poll returned %d, expected %d", r, expect);
+	}
+	return pfd.revents;
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+test_poll_timeouts(void)
+{
+	unsigned long start, elapsed;
+	int fds[2];
+	short revents;
+
+	printf("poll timeouts...\n");
+
+	dopipe(fds);
+
+	/* Empty pipe, no waiting */
+	start = now_ms();
+	revents = dopoll(fds[0], POLLIN, 0, 0);
+	elapsed = now_ms() - start;
+	if (revents != 0) {
+		errx(1, "poll 0: revents 0x%x on an empty pipe", revents);
+	}
+	if (elapsed >= TIMEOUT_MS) {
+		errx(1, "poll 0: took %lu ms", elapsed);
+	}
+
+	/* Empty pipe, finite wait */
+	start = now_ms();
+	revents = dopoll(fds[0], POLLIN, TIMEOUT_MS, 0);
+	elapsed = now_ms() - start;
+	if (revents != 0) {
+		errx(1, "poll %d: revents 0x%x on an empty pipe",
+		     TIMEOUT_MS, revents);
+	}
+	if (elapsed + SLOP_MS < TIMEOUT_MS) {
+		errx(1, "poll %d: returned after only %lu ms",
+		     TIMEOUT_MS, elapsed);
+	}
+
+	/* The write end has room */
+	revents = dopoll(fds[1], POLLOUT, 0, 1);
+	if (!(revents & POLLOUT)) {
+		errx(1, "poll: write end not writable (revents 0x%x)",
+		     revents);
+	}
+
+	/* Data already there, infinite wait */
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	revents = dopoll(fds[0], POLLIN, -1, 1);
+	if (!(revents & POLLIN)) {
+		errx(1, "poll -1: revents 0x%x, expected POLLIN", revents);
+	}
+
+	doclose(fds[0]);
+	doclose(fds[1]);
+}
+
+static
+void
+test_poll_wakeup(void)
+{
+	struct timespec ts;
+	int fds[2];
+	short revents;
+	pid_t pid;
+
+	printf("poll wakeup...\n");
+
+	dopipe(fds);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		doclose(fds[0]);
+		/* Make sure the parent is asleep in poll first */
+		ts.tv_sec = 0;
+		ts.tv_nsec = TIMEOUT_MS * 1000000;
+		if (nanosleep(&ts, NULL) < 0) {
+			err(1, "nanosleep");
+		}
+		if (write(fds[1], "x", 1) != 1) {
+			err(1, "write");
+		}
+		_exit(0);
+	}
+	doclose(fds[1]);
+
+	revents = dopoll(fds[0], POLLIN, -1, 1);
+	if (!(revents & POLLIN)) {
+		errx(1, "poll -1: revents 0x%x, expected POLLIN", revents);
+	}
+
+	doclose(fds[0]);
+	dowait(pid);
+}
+
+static
+void
+test_select(void)
+{
+	unsigned long start, elapsed;
+	struct timeval tv;
+	fd_set rfds, xfds;
+	int fds[2], r;
+
+	printf("select...\n");
+
+	/* No sets: just a sleep */
+	tv.tv_sec = 0;
+	tv.tv_usec = TIMEOUT_MS * 1000;
+	start = now_ms();
+	r = select(0, NULL, NULL, NULL, &tv);
+	elapsed = now_ms() - start;
+	if (r < 0) {
+		err(1, "select with no sets");
+	}
+	if (r != 0) {
+		errx(1, "select with no sets returned %d", r);
+	}
+	if (elapsed + SLOP_MS < TIMEOUT_MS) {
+		errx(1, "select with no sets: returned after only %lu ms",
+		     elapsed);
+	}
+
+	/*
+	 * A pipe whose writer is gone hangs up, but that doesn't put
+	 * it in the exception set, so select should wait it out.
+	 */
+	dopipe(fds);
+	doclose(fds[1]);
+	FD_ZERO(&xfds);
+	FD_SET(fds[0], &xfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = TIMEOUT_MS * 1000;
+	start = now_ms();
+	r = select(fds[0] + 1, NULL, NULL, &xfds, &tv);
+	elapsed = now_ms() - start;
+	if (r < 0) {
+		err(1, "select on a hung-up pipe");
+	}
+	if (r != 0 || FD_ISSET(fds[0], &xfds)) {
+		errx(1, "select on a hung-up pipe returned %d", r);
+	}
+	if (elapsed + SLOP_MS < TIMEOUT_MS) {
+		errx(1, "select on a hung-up pipe: returned after only "
+		     "%lu ms", elapsed);
+	}
+	doclose(fds[0]);
+
+	/* Readable pipe */
+	dopipe(fds);
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	FD_ZERO(&rfds);
+	FD_SET(fds[0], &rfds);
+	r = select(fds[0] + 1, &rfds, NULL, NULL, NULL);
+	if (r < 0) {
+		err(1, "select on a readable pipe");
+	}
+	if (r != 1 || !FD_ISSET(fds[0], &rfds)) {
+		errx(1, "select on a readable pipe returned %d", r);
+	}
+
+	/* Bad file handle: fds[1] is closed */
+	doclose(fds[1]);
+	FD_ZERO(&rfds);
+	FD_SET(fds[0], &rfds);
+	FD_SET(fds[1], &rfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	r = select((fds[0] > fds[1] ? fds[0] : fds[1]) + 1,
+		   &rfds, NULL, NULL, &tv);
+	if (r >= 0) {
+		errx(1, "select on a closed file handle returned %d", r);
+	}
+	if (errno != EBADF) {
+		err(1, "select on a closed file handle: expected EBADF, got");
+	}
+	doclose(fds[0]);
+}
+
+int
+main(void)
+{
+	test_poll_timeouts();
+	test_poll_wakeup();
+	test_select();
+	printf("Passed polltest.\n");
+	return 0;
+}